@@ -2,6 +2,22 @@
 #include "sensirion_common.h"
 #include "sensirion_i2c_hal.h"
 #include "stc3x_i2c.h"
+#include "compensation.h"
+#include "conversion.h"
+#include "clock.h"
+#include "power_profile.h"
+#include "timebase.h"
+#include "trace.h"
+#include "energy.h"
+#include "fram.h"
+#include "fram_log.h"
+#include "uart_export.h"
+#include "deep_sleep.h"
+#include "boot.h"
+#include "i2c_master.h"
+#include "spi_master.h"
+#include "task.h"
+#include "event.h"
 #include <inttypes.h>
 #include <msp430.h>
 #include <stdint.h>
@@ -21,7 +37,6 @@
 //******************************************************************************
 
 #define SLAVE_ADDR_MAX17260  0x36 // MAX17260
-#define MAX_BUFFER_SIZE 128
 
 /* MasterTypeX are example buffers initialized in the master, they will be
  * sent by the master to the slave.
@@ -59,43 +74,22 @@ uint8_t Test [2] = {0};
 // I2C FSM and Functions *******************************************************
 //******************************************************************************
 
-typedef enum I2C_ModeEnum{
-    IDLE_MODE,
-    NACK_MODE,
-    TX_REG_ADDRESS_MODE,
-    RX_REG_ADDRESS_MODE,
-    TX_DATA_MODE,
-    RX_DATA_MODE,
-    SWITCH_TO_RX_MODE,
-    SWITCH_TO_TX_MODE,
-    TIMEOUT_MODE
-} I2C_Mode;
-
-
-/* Used to track the state of the software state machine*/
-I2C_Mode MasterMode = IDLE_MODE;
-
-uint8_t TransmitRegAddr = 0;
-uint8_t ReceiveBuffer[MAX_BUFFER_SIZE] = {0};
-uint8_t RXByteCtr = 0;
-uint8_t ReceiveIndex = 0;
-uint8_t TransmitBuffer[MAX_BUFFER_SIZE] = {0};
-uint8_t TXByteCtr = 0;
-uint8_t TransmitIndex = 0;
-
 I2C_Mode I2C_Master_WriteReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t *reg_data, uint8_t count);
 I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count);
+void I2C_Master_ReadStart(uint8_t dev_addr, uint8_t reg_addr, uint8_t count);
 
 
-I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count)
+// starts a register read and returns, the data is in I2CBus.rx_buffer once
+// I2CBus.mode is back to IDLE_MODE (NACK_MODE: no data)
+void I2C_Master_ReadStart(uint8_t dev_addr, uint8_t reg_addr, uint8_t count)
 {
     /* Initialize state machine */
-    MasterMode = TX_REG_ADDRESS_MODE;
-    TransmitRegAddr = reg_addr;
-    RXByteCtr = count;
-    TXByteCtr = 0;
-    ReceiveIndex = 0;
-    TransmitIndex = 0;
+    I2CBus.mode = TX_REG_ADDRESS_MODE;
+    I2CBus.reg_addr = reg_addr;
+    I2CBus.rx_count = count;
+    I2CBus.tx_count = 0;
+    I2CBus.rx_index = 0;
+    I2CBus.tx_index = 0;
 
     /* Initialize slave address and interrupts */
     UCB0I2CSA = dev_addr;
@@ -103,27 +97,41 @@ I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count)
     UCB0IE &= ~UCRXIE;                       // Disable RX interrupt
     UCB0IE |= UCTXIE;                        // Enable TX interrupt
 
+    TRACE_EVENT(TRACE_REG_READ, reg_addr);
+    TRACE_EVENT(TRACE_I2C_START, dev_addr);
     UCB0CTLW0 |= UCTR + UCTXSTT;             // I2C TX, start condition
-    __bis_SR_register(LPM0_bits + GIE);              // Enter LPM0 w/ interrupts
+}
+
+
+I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count)
+{
+    ENERGY_BEGIN(ENERGY_GAUGE);
+
+    __disable_interrupt();
+    I2C_Master_ReadStart(dev_addr, reg_addr, count);
+    i2c_wait();
+    TRACE_EVENT(TRACE_I2C_STOP, dev_addr);
+    ENERGY_END();
 
-    return MasterMode;
+    return I2CBus.mode;
 
 }
 
 
 I2C_Mode I2C_Master_WriteReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t *reg_data, uint8_t count)
 {
+    ENERGY_BEGIN(ENERGY_GAUGE);
+
     /* Initialize state machine */
-    MasterMode = TX_REG_ADDRESS_MODE;
-    TransmitRegAddr = reg_addr;
+    I2CBus.mode = TX_REG_ADDRESS_MODE;
+    I2CBus.reg_addr = reg_addr;
 
-    //Copy register data to TransmitBuffer
-    CopyArray(reg_data, TransmitBuffer, count);
+    I2CBus.tx_data = reg_data;              // sent in place, the call blocks
 
-    TXByteCtr = count;
-    RXByteCtr = 0;
-    ReceiveIndex = 0;
-    TransmitIndex = 0;
+    I2CBus.tx_count = count;
+    I2CBus.rx_count = 0;
+    I2CBus.rx_index = 0;
+    I2CBus.tx_index = 0;
 
     /* Initialize slave address and interrupts */
     UCB0I2CSA = dev_addr;
@@ -131,56 +139,43 @@ I2C_Mode I2C_Master_WriteReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t *reg_da
     UCB0IE &= ~UCRXIE;                       // Disable RX interrupt
     UCB0IE |= UCTXIE;                        // Enable TX interrupt
 
+    TRACE_EVENT(TRACE_REG_WRITE, reg_addr);
+    TRACE_EVENT(TRACE_I2C_START, dev_addr);
+    __disable_interrupt();
     UCB0CTLW0 |= UCTR + UCTXSTT;             // I2C TX, start condition
-    __bis_SR_register(LPM0_bits + GIE);              // Enter LPM0 w/ interrupts
+    i2c_wait();
+    TRACE_EVENT(TRACE_I2C_STOP, dev_addr);
+    ENERGY_END();
 
-    return MasterMode;
+    return I2CBus.mode;
 }
 
 //******************************************************************************
-// General SPI State Machine ***************************************************
+// Device Initialization *******************************************************
 //******************************************************************************
 
-void SendUCA1Data(uint8_t val);
-I2C_Mode SPI_Master_WriteReg(uint8_t reg_addr, uint8_t *reg_data, uint8_t count);
-
-
-void SendUCA1Data(uint8_t val)
-{
-    while (!(UCA1IFG & UCTXIFG));           // USCI_A1 TX buffer ready?
-    UCA1TXBUF = val;
-}
-
-
-I2C_Mode SPI_Master_WriteReg(uint8_t reg_addr, uint8_t *reg_data, uint8_t count)
-{
-    MasterMode = TX_DATA_MODE; // instead of TX_REG_ADDRESS_MODE
-    TransmitRegAddr = reg_addr;
-
-    // Copy register data to TransmitBuffer
-    CopyArray(reg_data, TransmitBuffer, count);
+// STC31 supply switch (P3.2). The state is kept in FRAM, a wake-up from
+// LPM3.5 has to find the rail as it was before LOCKLPM5 is cleared.
+#define SENSOR_POWER_OUT     P3OUT
+#define SENSOR_POWER_DIR     P3DIR
+#define SENSOR_POWER_PIN     BIT2
 
-    TXByteCtr = count;
-    RXByteCtr = 0;
-    ReceiveIndex = 0;
-    TransmitIndex = 0;
-
-    //SLAVE_CS_OUT &= ~(SLAVE_CS_PIN);
-    SendUCA1Data(TransmitBuffer[0]); // send first byte instead of address
-    TXByteCtr--;
-    TransmitIndex++;
-
-     __bis_SR_register(CPUOFF + GIE);        // Enter LPM0 w/interrupts enabled
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(SensorPower)
+#endif
+FRAM_PERSISTENT uint8_t SensorPower = 1;
 
-    //SLAVE_CS_OUT |= SLAVE_CS_PIN;
-    return MasterMode;
+// switches the STC31 supply and records it
+void sensor_power(uint8_t on){
+    if (on)
+        SENSOR_POWER_OUT |= SENSOR_POWER_PIN;
+    else
+        SENSOR_POWER_OUT &= ~SENSOR_POWER_PIN;
+    FRAM_WRITE_ENABLE();
+    SensorPower = on;
+    FRAM_WRITE_DISABLE();
 }
 
-
-//******************************************************************************
-// Device Initialization *******************************************************
-//******************************************************************************
-
 void initGPIO()
 {
     // Configure GPIO
@@ -197,12 +192,13 @@ void initGPIO()
     SLAVE_CS_DIR |= SLAVE_CS_PIN;
     SLAVE_CS_OUT &= ~SLAVE_CS_PIN;
 
-    // turn on both power switches for level shifter and sensor
+    // turn on both power switches for level shifter and sensor, the sensor
+    // stays off after LPM3.5 if a tier without measurement switched it off
     P3DIR |= BIT0;
     P3OUT |= BIT0;
-    P3DIR |= BIT2;
-    P3OUT |= BIT2;
-    _delay_cycles(1600);
+    SENSOR_POWER_DIR |= SENSOR_POWER_PIN;
+    sensor_power(!deep_sleep_woke() || SensorPower);
+    CLOCK_DELAY_US(100);
 
     // turn off LED
     P2DIR |= 0x01;
@@ -239,10 +235,10 @@ void initSPI()
     UCA1CTLW0 = UCSWRST;                    // **Put eUSCI module in reset**
     UCA1CTLW0 |= /*UCCKPL |*/ UCCKPH | UCMSB | UCSYNC |
                  UCMST | UCSSEL__SMCLK;
-    UCA1BRW = 80;                           // BRCLK / UCBRx = UCxCLK
-                                            // 8MHz  / 80    = 100kHz
+    UCA1BRW = CLOCK_DIVIDER(CLOCK_SPI_HZ);  // BRCLK / UCBRx = UCxCLK
+                                            // 16MHz / 80    = 200kHz
     UCA1CTLW0 &= ~UCSWRST;                  // **Initialize eUSCI module**
-    UCA1IE |= UCRXIE;                       // Enable eUSCI0 RX interrupt
+    // spi_start() enables the interrupts per transfer
 }
 
 
@@ -252,7 +248,7 @@ void initI2C()
     UCB0CTLW0 |= UCMODE_3 | UCMST | UCSSEL__SMCLK | UCSYNC; // I2C master mode, SMCLK
     UCB0CTLW1 |= UCASTP_2;                    // Automatic stop generated
                                               // after UCB0TBCNT is reached
-    UCB0BRW = 160;                            // fSCL = SMCLK/160 = ~100kHz
+    UCB0BRW = CLOCK_DIVIDER(CLOCK_I2C_HZ);    // fSCL = ~100kHz
     UCB0I2CSA = 0x29;                         // Slave Address
     UCB0CTLW0 &= ~UCSWRST;                    // Clear SW reset, resume operation
     UCB0IE |= UCRXIE | UCNACKIE;
@@ -265,95 +261,114 @@ void initI2C()
 //******************************************************************************
 
 
-void initializeConfig(void){
-    FSTAT[0] = 0;
-    while(FSTAT[0] & 0x01){
-        _delay_cycles(160000); // 10ms Wait Loop. Do not continue until FSTAT.DNR==0
-        I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x3D, 2);
-        CopyArray(ReceiveBuffer, FSTAT, 2);
-    }
+#define GAUGE_POLL_TICKS     328 // ~10ms at ACLK = 32768Hz
 
+typedef enum GaugeInitStateEnum{
+    GAUGE_INIT_WAIT_DNR,     // wait for FSTAT.DNR == 0 after power-up
+    GAUGE_INIT_CONFIG,       // write EZ config
+    GAUGE_INIT_WAIT_REFRESH, // wait for ModelCFG.Refresh == 0
+    GAUGE_INIT_DONE
+} GaugeInitState;
 
-    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0xDB, 2);
-    CopyArray(ReceiveBuffer, HibCFG, 2); //Store original HibCFG value
+typedef enum GaugeEventEnum{
+    GAUGE_EVENT_NONE,        // step done, call gauge_init_step() again
+    GAUGE_EVENT_POLL,        // wait GAUGE_POLL_TICKS before the next step
+    GAUGE_EVENT_READY        // gauge configured, POR flag cleared
+} GaugeEvent;
 
-    I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0x60 , Write1, 2); // Exit Hibernate Mode step 1
-    I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0xBA , Write2, 2); // Exit Hibernate Mode step 2
-    I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0x60 , Write2, 2); // Exit Hibernate Mode step 3
+GaugeInitState GaugeState = GAUGE_INIT_DONE;
 
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x18, DesignCap, 2); // Design Capacity
 
-    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x18, 2);
-    CopyArray(ReceiveBuffer, Test, 2); //test if Design Capacity was written
+// (re)starts the gauge bring-up, e.g. after Status.POR has been seen
+void gauge_init_start(void){
+    GaugeState = GAUGE_INIT_WAIT_DNR;
+}
 
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x1E, IchgTerm, 2); // Termination Current
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x3A, VEmpty, 2); // Empty Voltage
+// advances the bring-up by one step, never blocks
+GaugeEvent gauge_init_step(void){
+    switch(GaugeState){
 
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xDB, Write3, 2); // Write ModelCFG, because ChargeVoltage < 4.275V
+        case GAUGE_INIT_WAIT_DNR:
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x3D, 2);
+            CopyArray(I2CBus.rx_buffer, FSTAT, 2);
+            if (FSTAT[0] & 0x01){ // FSTAT.DNR: data not ready yet
+                return GAUGE_EVENT_POLL;
+            }
+            GaugeState = GAUGE_INIT_CONFIG;
+            return GAUGE_EVENT_NONE;
 
-    // Poll ModelCFG.Refresh(highest bit), proceed to Step 3 when ModelCFG.Refresh==0.
-    ModelCFG[1] = 0;
-    while (ModelCFG[1] & 0x80){
-        _delay_cycles(160000); // 10ms Wait Loop. Do not continue until ModelCFG.Refresh==0
-        I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0xDB, 2);
-        CopyArray(ReceiveBuffer, ModelCFG, 2);
-    }
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xBA , HibCFG, 2); // Restore Original HibCFG value
+        case GAUGE_INIT_CONFIG:
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0xBA, 2);
+            CopyArray(I2CBus.rx_buffer, HibCFG, 2); //Store original HibCFG value
 
-    // enable hibernate mode -> one measurement every 5.625 seconds
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xBA , EnHib, 2);
+            I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0x60 , Write1, 2); // Exit Hibernate Mode step 1
+            I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0xBA , Write2, 2); // Exit Hibernate Mode step 2
+            I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0x60 , Write2, 2); // Exit Hibernate Mode step 3
 
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x18, DesignCap, 2); // Design Capacity
 
-    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2); //Read Status
-    CopyArray(ReceiveBuffer, Status, 2);
-    Status[1] &= 0xFF;
-    Status[0] &= 0xFD;
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x00, Status, 2);
-}
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x18, 2);
+            CopyArray(I2CBus.rx_buffer, Test, 2); //test if Design Capacity was written
 
-// concatenates two uint8 to one uint16, needed for convert
-uint16_t concatenate(uint8_t d1, uint8_t d2) {
-    uint16_t wd = ((uint16_t)d1 << 8) | d2;
-    return wd;
-}
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x1E, IchgTerm, 2); // Termination Current
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x3A, VEmpty, 2); // Empty Voltage
 
-// converts 16 bits to integer value which then can be printed
-uint16_t convertCAP(uint16_t data) {
-    uint16_t res;
-    res = 50*data;
-    return res;
-}
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xDB, Write3, 2); // Write ModelCFG, because ChargeVoltage < 4.275V
+            GaugeState = GAUGE_INIT_WAIT_REFRESH;
+            return GAUGE_EVENT_POLL;
 
-// converts 16 bits to integer value which then can be printed
-uint16_t convertSOC(uint16_t data) {
-    uint16_t res;
-    res = data>>8;
-    return res;
-}
+        case GAUGE_INIT_WAIT_REFRESH:
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0xDB, 2);
+            CopyArray(I2CBus.rx_buffer, ModelCFG, 2);
+            if (ModelCFG[1] & 0x80){ // ModelCFG.Refresh: model still loading
+                return GAUGE_EVENT_POLL;
+            }
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xBA , HibCFG, 2); // Restore Original HibCFG value
+
+            // enable hibernate mode -> one measurement every 5.625 seconds
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xBA , EnHib, 2);
+
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2); //Read Status
+            CopyArray(I2CBus.rx_buffer, Status, 2);
+            Status[0] &= 0xFD; // clear Status.POR
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x00, Status, 2);
+            GaugeState = GAUGE_INIT_DONE;
+            return GAUGE_EVENT_READY;
 
-uint16_t convertV(uint16_t data) {
-    uint16_t res;
-    res = (data>>7)*10;
-    return res;
+        case GAUGE_INIT_DONE:
+        default:
+            return GAUGE_EVENT_READY;
+    }
 }
 
-uint16_t convertCurrent(uint16_t data) {
-    uint16_t res;
-    res = data*16;
-    return res;
+// sleeps in LPM3 for one poll interval, timer is stopped again afterwards
+void gauge_poll_sleep(void){
+    TA0CCTL0 |= CCIE;
+    TA0CCR0 = GAUGE_POLL_TICKS;
+    TA0CTL = TASSEL__ACLK | MC__UP | TACLR;
+    ENERGY_BEGIN(ENERGY_SLEEP);
+    POWER_PROFILE_SLEEP(POWER_LPM3, LPM3_bits + GIE); // Enter LPM3 w/ interrupts
+    ENERGY_END();
+    TA0CTL = MC__STOP | TACLR;
 }
 
-uint16_t complement(uint16_t data) {
-    uint16_t res;
-    res = ~data + 1;
-    return res;
+// runs the bring-up to completion, sleeping while the gauge is busy
+void initializeConfig(void){
+    GaugeEvent event;
+
+    gauge_init_start();
+    do {
+        event = gauge_init_step();
+        if (event == GAUGE_EVENT_POLL){
+            gauge_poll_sleep();
+        }
+    } while (event != GAUGE_EVENT_READY);
 }
 
 //******************************************************************************
 // Display Functions ***********************************************************
 //******************************************************************************
 
-#define DUMMY                   0xFF
 #define DISPLAY_SIZEX    128
 #define DISPLAY_SIZEY    128
 #define DISPLAY_NUMBYTES ((DISPLAY_SIZEX*DISPLAY_SIZEY)/8) //8 PIXEL/BYTE
@@ -363,16 +378,16 @@ void display_clear()
 {
     //set CS
     SLAVE_CS_OUT |= SLAVE_CS_PIN;
-    _delay_cycles(16); //delay_us(1);
+    CLOCK_DELAY_US(1);
 
     // Send clear command
     uint8_t  NVM_READ_CMD[2] = {0x60 /* 0x02 | display_com*/, 0x00};
     uint16_t NVM_READ_CMD_SIZE = 2;
-    SPI_Master_WriteReg(0,NVM_READ_CMD,NVM_READ_CMD_SIZE);
+    SPI_Master_WriteReg(NVM_READ_CMD,NVM_READ_CMD_SIZE);
 
 
     //unset CS of display
-    _delay_cycles(16); //delay_us(1);
+    CLOCK_DELAY_US(1);
     SLAVE_CS_OUT &= ~SLAVE_CS_PIN;
 }
 
@@ -382,58 +397,69 @@ void display_init()
     SLAVE_CS_OUT &= ~SLAVE_CS_PIN;
 
     //clear display
-    _delay_cycles(160); //delay_us(10);
+    CLOCK_DELAY_US(10);
     display_clear();
-    _delay_cycles(160); //delay_us(10);
+    CLOCK_DELAY_US(10);
 
 }
 
-//refreshes LCD memory with new pixel data
-void display_update(uint8_t *image_binary)
+// LCD lines of the CO2 reading, sent last in a frame (LCD_GRAM rows are x)
+#define DISPLAY_GAS_FIRST   28
+#define DISPLAY_GAS_END     104
+
+// raises CS and sends the write command, the lines follow with
+// display_line_start()
+void display_frame_start(void)
 {
-    uint8_t bytes_per_line =  16; //DISPLAY_SIZEX / 8;
-    //uint16_t totalbytes = (DISPLAY_SIZEX * DISPLAY_SIZEY) / 8;
+    uint8_t  NVM_READ_CMD[1] = {0x80 | display_com};
+
+    TRACE_EVENT(TRACE_DISPLAY_START, 0);
 
     //set CS
     SLAVE_CS_OUT |= SLAVE_CS_PIN;
-    _delay_cycles(16); //delay_us(1);
+    CLOCK_DELAY_US(1);
 
     //transfer write command: 0x01
-    uint8_t  NVM_READ_CMD[1] = {0x80 | display_com};
-    uint16_t NVM_READ_CMD_SIZE = 1;
-    SPI_Master_WriteReg(0,NVM_READ_CMD,NVM_READ_CMD_SIZE);
+    spi_start(NVM_READ_CMD, 1);
     display_com = display_com ^ display_com_mask;       //toggle COM signal
+}
 
-    //transfer (pixel) data line-by-line
-    uint16_t i = 0;
-    for (; i < /*DISPLAY_SIZEY*/128; ++i) {
-        uint8_t line[/*bytes_per_line + 2*/18];
-        // Send address byte
-        uint8_t currentline = (i+1); //((i + 1) / (WIDTH / 8)) + 1;
-        //swap bit direction (LSB-> MSB)
-        uint8_t spi_Byte_temp = 0;
-        int k;
-        for(k = 0; k<8; ++k){
-          spi_Byte_temp |= (currentline & 0x01) << (7-k);
-          currentline = currentline >>1;
-        }
-        line[0] = spi_Byte_temp;
-        // copy over this line
-        memcpy(line + 1, image_binary + (i*bytes_per_line), bytes_per_line);
-        // Send end of line
-        line[bytes_per_line + 1] = 0x00;
-        // send it!
-        SPI_Master_WriteReg(0,line, bytes_per_line + 2);
+// starts sending line i of the image, the SPI bus must be idle
+void display_line_start(const uint8_t *image_binary, uint8_t i)
+{
+    uint8_t bytes_per_line =  16; //DISPLAY_SIZEX / 8;
+    uint8_t line[/*bytes_per_line + 2*/18];
+    // Send address byte
+    uint8_t currentline = (i+1); //((i + 1) / (WIDTH / 8)) + 1;
+    //swap bit direction (LSB-> MSB)
+    uint8_t spi_Byte_temp = 0;
+    int k;
+    for(k = 0; k<8; ++k){
+      spi_Byte_temp |= (currentline & 0x01) << (7-k);
+      currentline = currentline >>1;
     }
+    line[0] = spi_Byte_temp;
+    // copy over this line
+    CopyArray(image_binary + (i*bytes_per_line), line + 1, bytes_per_line);
+    // Send end of line
+    line[bytes_per_line + 1] = 0x00;
+    // send it!
+    spi_start(line, bytes_per_line + 2);
+}
+
+// sends the trailer of the last line and lowers CS
+void display_frame_end(void)
+{
+    uint8_t  NVM_READ_CMD[1] = {0x00};
 
     // Send dummy byte for the last line
-    NVM_READ_CMD[1] = 0x00;
-    NVM_READ_CMD_SIZE = 1;
-    SPI_Master_WriteReg(0,NVM_READ_CMD,NVM_READ_CMD_SIZE);
+    SPI_Master_WriteReg(NVM_READ_CMD, 1);
 
     //unset CS
-    _delay_cycles(16); //delay_us(1);
+    CLOCK_DELAY_US(1);
     SLAVE_CS_OUT &= ~SLAVE_CS_PIN;
+
+    TRACE_EVENT(TRACE_DISPLAY_END, 0);
 }
 
 
@@ -502,13 +528,14 @@ void lcd_print_char(uint8_t x,uint8_t y,uint8_t chr,uint8_t size,uint8_t mode)
     uint8_t temp,t,t1;
     uint8_t y0=y;
     uint8_t csize=(size/8+((size%8)?1:0))*(size>>1);
-    chr=chr-' ';
+    const unsigned char *glyph;
+    if(size==12&&chr>=FONT_1206_FIRST&&chr<=FONT_1206_LAST)glyph=asc2_1206[chr-FONT_1206_FIRST];
+    else if(size==16&&chr>=FONT_1608_FIRST&&chr<=FONT_1608_LAST)glyph=asc2_1608[chr-FONT_1608_FIRST];
+    else if(size==24&&chr>=FONT_2412_FIRST&&chr<=FONT_2412_LAST)glyph=asc2_2412[chr-FONT_2412_FIRST];
+    else return; // no such size or glyph
     for(t=0;t<csize;t++)
     {
-        if(size==12)temp=asc2_1206[chr][t];
-        else if(size==16)temp=asc2_1608[chr][t];
-        else if(size==24)temp=asc2_2412[chr][t];
-        else return;
+        temp=glyph[t];
         for(t1=0;t1<8;t1++)
         {
             if(temp&0x80)lcd_drawpoint(x,y,mode);
@@ -570,451 +597,615 @@ void lcd_print_string(uint8_t x,uint8_t y,const uint8_t *p,uint8_t size)
 // Main ************************************************************************
 //******************************************************************************
 
-uint16_t resultCAP;
-uint16_t resultSOC;
-uint16_t resultV;
-uint16_t resultCurrent;
-
-const uint16_t thresholdSOC = 30;
-const uint16_t thresholdSOC_hysteresis = 20;
+uint32_t resultCAP;     // uAh
+uint16_t resultSOC;     // %
+uint16_t resultV;       // mV
+int32_t resultCurrent;  // uA, negative while discharging
+uint8_t SoC_bar;
+uint32_t SoC_percentage;
 
 int16_t error = 0;
-uint16_t gas_ticks;
-uint16_t temperature_ticks;
-uint32_t gas;
-double temperature;
+uint32_t gas;           // ppm, first sensor
+int16_t temperature;    // 0.01 degC, first sensor
+
+// STC31s fitted, strapped from STC3X_I2C_ADDRESS up. They are measured in one
+// pipelined burst; the display and the log show the first one.
+#ifndef GAS_SENSORS
+#define GAS_SENSORS     1
+#endif
+#if GAS_SENSORS < 1 || GAS_SENSORS > STC3X_I2C_ADDRESS_LAST - STC3X_I2C_ADDRESS + 1
+#error GAS_SENSORS must be 1 to 4
+#endif
 
+const Stc3x GasSensors[GAS_SENSORS] = {
+    {STC3X_I2C_ADDRESS},
+#if GAS_SENSORS > 1
+    {STC3X_I2C_ADDRESS + 1},
+#endif
+#if GAS_SENSORS > 2
+    {STC3X_I2C_ADDRESS + 2},
+#endif
+#if GAS_SENSORS > 3
+    {STC3X_I2C_ADDRESS + 3},
+#endif
+};
+Stc3xSample GasSamples[GAS_SENSORS];
+
+
+//******************************************************************************
+// Mode Ladder *****************************************************************
+//******************************************************************************
 
-// Finite state machine
+// Finite state machine, the tiers in ascending order of consumption
 typedef enum ModeEnum{
+    CRITICAL,
     POWERSAVING,
-    NORMAL
+    NORMAL,
+    PERFORMANCE,
+    MODES
 } Mode;
 
+typedef enum DisplayPolicyEnum{
+    DISPLAY_FROZEN,     // the LCD keeps the last image, no SPI traffic
+    DISPLAY_UPDATE      // redrawn every cycle
+} DisplayPolicy;
+
+typedef struct ModeTierStruct{
+    uint16_t period_ms;     // LPM3 sleep after the work, at most 127 s
+    uint8_t sensor;         // STC31 measurement every cycle, else powered off
+    uint8_t display;        // DisplayPolicy
+    uint8_t gauge_every;    // gauge read every n-th cycle
+    uint8_t enter_soc;      // %, step up into this tier above
+    uint8_t exit_soc;       // %, step down from this tier below
+    uint8_t charging;       // only while AvgCurrent > 0
+    uint8_t deep;           // sleep in LPM3.5, see deep_sleep.h
+    const char *label;      // its row on the display, ticked while active
+} ModeTier;
+
+// one step per cycle; keep enter_soc above exit_soc of the same tier
+const ModeTier ModeLadder[MODES] = {
+    // period  sensor display         gauge enter exit charging deep label
+    {  60000,  0,     DISPLAY_FROZEN, 1,    0,    0,   0,       1,   "Critical"},
+    {   8000,  1,     DISPLAY_UPDATE, 1,    10,   5,   0,       1,   "Power Saving"},
+    {   1000,  1,     DISPLAY_UPDATE, 1,    30,   20,  0,       0,   "Normal Mode"},
+    {    500,  1,     DISPLAY_UPDATE, 4,    80,   70,  1,       0,   "Performance"},
+};
+
+#define MODE_TICKS(ms)      ((uint32_t)(ms) * 64 / 125)     // ACLK/64, 512 Hz
+
+#define DEEP_HOLD_CYCLES    4   // LPM3 cycles after the last UART export activity
+
 Mode MainMode = NORMAL;
+uint8_t GaugeSkip = 0;
+uint16_t LogMs = 0;     // log clock below one second
+uint8_t DeepHold = 0;
+
+// moves at most one tier up or down the ladder
+Mode mode_next(Mode mode){
+    const ModeTier *tier = &ModeLadder[mode];
+    const ModeTier *up = &ModeLadder[mode + 1];
+
+    if (mode > CRITICAL &&
+        (resultSOC < tier->exit_soc || (tier->charging && resultCurrent <= 0))){
+        return mode - 1;
+    }
+    if (mode < MODES - 1 && resultSOC > up->enter_soc &&
+        (!up->charging || resultCurrent > 0)){
+        return mode + 1;
+    }
+    return mode;
+}
+
+// sleeps in LPM3 for the tier period. TA0 is set up completely, the gauge
+// bring-up uses it as well.
+void mode_sleep(uint16_t period_ms){
+    TA0CTL = MC__STOP | TACLR;
+    TA0EX0 = TAIDEX_7;                      // with ID__8 ACLK/64
+    TA0CCR0 = MODE_TICKS(period_ms) - 1;
+    TA0CCTL0 = CCIE;
+    TA0CTL = TASSEL__ACLK | MC__UP | ID__8 | TACLR;
+    POWER_PROFILE_SLEEP(POWER_LPM3, LPM3_bits + GIE); // Enter LPM3 w/ interrupts
+    TA0CTL = MC__STOP | TACLR;
+    TA0EX0 = TAIDEX_0;
+}
 
 
-int main(void){
-    WDTCTL = WDTPW | WDTHOLD;   // Stop watchdog timer
-    initClockTo16MHz();
-    initGPIO();
-    initSPI();
-    initI2C();
-    initializeConfig(); // initialize gauge
-    display_init();
+//******************************************************************************
+// Deep Sleep Context **********************************************************
+//******************************************************************************
+
+// main loop state kept in FRAM over LPM3.5. The gauge, the STC31 (if powered,
+// see SensorPower) and the LCD keep theirs; LCD_GRAM is redrawn completely by
+// the next display_render().
+typedef struct ContextStruct{
+    uint32_t cap;
+    uint32_t gas;
+    int32_t current;
+    uint16_t soc;
+    uint16_t v;
+    int16_t temperature;
+    uint16_t log_ms;
+    uint8_t mode;
+    uint8_t gauge_skip;
+    uint8_t display_com;
+} Context;
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(DeepContext)
+#endif
+FRAM_PERSISTENT Context DeepContext = {0};
+
+// saves the context and sleeps in LPM3.5 until the RTC or the UART export
+// wakes the device through a reset. Returns only if an interrupt came first,
+// without having slept; the log then goes on as if nothing was suspended.
+void context_sleep(uint16_t seconds){
+    FRAM_WRITE_ENABLE();
+    DeepContext.cap = resultCAP;
+    DeepContext.gas = gas;
+    DeepContext.current = resultCurrent;
+    DeepContext.soc = resultSOC;
+    DeepContext.v = resultV;
+    DeepContext.temperature = temperature;
+    DeepContext.log_ms = LogMs;
+    DeepContext.mode = MainMode;
+    DeepContext.gauge_skip = GaugeSkip;
+    DeepContext.display_com = display_com;
+    FRAM_WRITE_DISABLE();
+    fram_log_suspend();
+
+    uart_export_park();
+    deep_sleep(seconds);
+    uart_export_init();
+    fram_log_resume();
+}
+
+void context_restore(void){
+    resultCAP = DeepContext.cap;
+    gas = DeepContext.gas;
+    resultCurrent = DeepContext.current;
+    resultSOC = DeepContext.soc;
+    resultV = DeepContext.v;
+    temperature = DeepContext.temperature;
+    LogMs = DeepContext.log_ms;
+    MainMode = (Mode)DeepContext.mode;
+    GaugeSkip = DeepContext.gauge_skip;
+    display_com = DeepContext.display_com;
+}
+
+
+//******************************************************************************
+// Boot Sequence ***************************************************************
+//******************************************************************************
+
+#define SENSOR_CONFIG_STEPS  2
+#define SENSOR_SETTLE_MS     100 // after the last setting, before the first measurement
+#define SENSOR_POWER_UP_MS   12  // STC31 power-up time, then it takes commands
 
-    // crystal setup
+// requests XT1 for ACLK. The clock system keeps ACLK on REFO until the
+// crystal has started, meanwhile the rest of the boot goes on.
+void xt1_start(void){
     CSCTL4 = SELMS__DCOCLKDIV | SELA__XT1CLK;          // MCLK=SMCLK=DCO; ACLK=XT1
     P2SEL0 |= BIT0 + BIT1;                             // P2.0: XOUT; P2.1: XI1
+}
+
+// waits until XT1 runs, usually it already does
+void xt1_wait(void){
     do
     {
         CSCTL7 &= ~(XT1OFFG | DCOFFG);      // Clear XT1 and DCO fault flag
         SFRIFG1 &= ~OFIFG;
     }while (SFRIFG1 & OFIFG);               // Test oscillator fault flag
+}
+
+// CO2 in air, 0 to 25 vol%
+static const uint8_t BinaryGasFrame[STC3X_SET_FRAME_SIZE] = STC3X_SET_BINARY_GAS_FRAME(0x0003);
 
-    // initialize sensor
-     error = stc3x_set_binary_gas(0x0003);
-     //if (error) P2OUT = 0x01;
+// one STC31 setting per call on every sensor, step 0 .. SENSOR_CONFIG_STEPS - 1
+void sensor_config(uint8_t step){
+    uint8_t i;
 
-     uint16_t relative_humidity_ticks = 38767; // 60% rel. humidity (32767 = 50%)
-     error = stc3x_set_relative_humidity(relative_humidity_ticks);
-     //if (error) P2OUT = 0x01;
+    switch(step){
+        case 0:
+            for (i = 0; i < GAS_SENSORS; i++){
+                error = stc3x_set_frame(&GasSensors[i], BinaryGasFrame);
+            }
+            break;
+        default:
+            error = comp_boot(GasSensors, GAS_SENSORS); // humidity, temperature, pressure
+            break;
+    }
+    //if (error) P2OUT = 0x01;
+}
 
-     uint16_t absolute_pressure = 980; // 980 mbar pressure
-     error = stc3x_set_pressure(absolute_pressure);
-     //if (error) P2OUT = 0x01;
+// cold boot of gauge, sensor and display. The STC31 settings go out while the
+// gauge is busy and the display is cleared while the sensor settles. Returns
+// the clock tick from which the sensor can be measured.
+uint16_t boot_devices(void){
+    GaugeEvent event;
+    uint8_t step = 0;
+    uint16_t ready = 0;
+
+    gauge_init_start();
+    do {
+        event = gauge_init_step();
+        if (event == GAUGE_EVENT_POLL){
+            if (step < SENSOR_CONFIG_STEPS){
+                sensor_config(step++);
+                ready = clock_ticks() + CLOCK_MS_TICKS(SENSOR_SETTLE_MS);
+            }
+            gauge_poll_sleep();
+        }
+    } while (event != GAUGE_EVENT_READY);
 
-    _delay_cycles(1600000);  // 100ms delay
+    while (step < SENSOR_CONFIG_STEPS){ // the gauge was ready at once
+        sensor_config(step++);
+        ready = clock_ticks() + CLOCK_MS_TICKS(SENSOR_SETTLE_MS);
+    }
+    display_init();
+    return ready;
+}
 
-    while(1){
-        switch(MainMode){
-
-            case POWERSAVING:
-
-                // Sensor Measurement
-                error = stc3x_measure_gas_concentration(&gas_ticks, &temperature_ticks);
-                if (error) {
-                    //P2OUT = 0x01;
-                } else {
-                    gas = 100000*(gas_ticks-16384)/32768; // ppm
-                    //temperature = (double)temperature_ticks / 200.0;
-                }
-
-
-                // Gauge Measurement
-                I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2);
-                CopyArray(ReceiveBuffer, Status, 2);
-                StatusPOR[0] = Status[0] & 0x02;
-
-                if (StatusPOR[0] == 0x01){
-                    initializeConfig();
-                }
-
-                I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2);
-                CopyArray(ReceiveBuffer, Status, 2);
-                StatusPOR[0] = Status[0] & 0x02;
-
-                if (StatusPOR[0] == 0x00){
-                    // Read Capacity
-                    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x05, 2);
-                    CopyArray(ReceiveBuffer, RepCAP, 2);
-                    resultCAP = convertCAP(concatenate(RepCAP[1], RepCAP[0]));
-
-                    // Read State of Charge
-                    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x06, 2);
-                    CopyArray(ReceiveBuffer, RepSOC, 2);
-                    resultSOC = convertSOC(concatenate(RepSOC[1], RepSOC[0]));
-
-                    // Read Cell Voltage
-                    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x19, 2);
-                    CopyArray(ReceiveBuffer, Vcell, 2);
-                    resultV = convertV(concatenate(Vcell[1], Vcell[0]));
-
-                    // Read Average Current
-                    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x0B, 2); // average current over last 5 seconds
-                    CopyArray(ReceiveBuffer, AvgCurrent, 2);
-                    resultCurrent = convertCurrent(concatenate(AvgCurrent[1], AvgCurrent[0]));
-
-                if (resultSOC > thresholdSOC){ // check if threshold State of Charge has been reached
-                    MainMode = NORMAL;
-                }
-
-
-                // update display
-                uint8_t SoC_bar = resultSOC*28/100; // compute thickness of bar
-                uint32_t SoC_percentage = resultSOC;
-
-                lcd_fillRect(16,16,32,24,1);
-                lcd_fillRect(48,24,4,8,1);
-                lcd_fillRect(18,18,SoC_bar,20,0);
-
-                lcd_print_num(92,16,SoC_percentage,2,12);
-                lcd_print_char(110,16,'%',12,1);
-
-                if(resultCurrent&0x8000) {
-                    resultCurrent = complement(resultCurrent);
-                    lcd_print_string(68,28,"-",12);
-                    lcd_print_num(76,28,resultCurrent,4,12);
-                    lcd_print_string(104,28,"uA",12);
-                }
-                else {
-                    lcd_print_num(76,28,resultCurrent,4,12);
-                    lcd_print_string(104,28,"uA",12);
-                }
-                //lcd_print_num(76,28,resultV,4,12);
-                //lcd_print_string(104,28,"mV",12);
-
-                lcd_print_string(40,48,"Normal Mode",12);
-                lcd_fillRect(24,48,12,12,1);
-                lcd_print_string(40,64,"Power Saving",12);
-                lcd_fillRect(24,64,12,12,1);
-
-                lcd_print_num(28,88,gas,4,24);
-                lcd_print_string(80,88,"ppm",16);
-
-                lcd_fillRect(24,48,12,12,1); // power saving
-                lcd_fillRect(26,66,8,8,0);
-
-                display_update(LCD_GRAM);
-
-
-                // go into LPM3 for 8 seconds
-                TA0CCTL0 |= CCIE;
-                TA0CCR0 = 32768;
-                TA0CTL |= TASSEL__ACLK | MC__UP | ID__8; // set clock to ACLK/8
-                __bis_SR_register(LPM3_bits + GIE);  // Enter LPM3 w/ interrupts
-                break;
+// powers the STC31 up again after a tier without measurement and writes its
+// settings, which the sensor lost with its supply. Returns the clock tick
+// from which it can be measured.
+uint16_t sensor_wake(void){
+    uint8_t step;
 
+    sensor_power(1);
+    clock_sleep_ms(SENSOR_POWER_UP_MS);
+    for (step = 0; step < SENSOR_CONFIG_STEPS; step++){
+        sensor_config(step);
+    }
+    return clock_ticks() + CLOCK_MS_TICKS(SENSOR_SETTLE_MS);
+}
 
-            case NORMAL:
-
-                // Sensor Measurement
-                error = stc3x_measure_gas_concentration(&gas_ticks, &temperature_ticks);
-                if (error) {
-                    //P2OUT = 0x01;
-                } else {
-                    gas = 100000*(gas_ticks-16384)/32768; // ppm
-                    //temperature = (double)temperature_ticks / 200.0;
-                }
-
-
-                // Gauge Measurement
-                I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2);
-                CopyArray(ReceiveBuffer, Status, 2);
-                StatusPOR[0] = Status[0] & 0x02;
-
-                if (StatusPOR[0] == 0x01){
-                    initializeConfig();
-                }
-
-                I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2);
-                CopyArray(ReceiveBuffer, Status, 2);
-                StatusPOR[0] = Status[0] & 0x02;
-
-                if (StatusPOR[0] == 0x00){
-                    // Read Capacity
-                    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x05, 2);
-                    CopyArray(ReceiveBuffer, RepCAP, 2);
-                    resultCAP = convertCAP(concatenate(RepCAP[1], RepCAP[0]));
-
-                    // Read State of Charge
-                    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x06, 2);
-                    CopyArray(ReceiveBuffer, RepSOC, 2);
-                    resultSOC = convertSOC(concatenate(RepSOC[1], RepSOC[0]));
-
-                    // Read Cell Voltage
-                    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x19, 2);
-                    CopyArray(ReceiveBuffer, Vcell, 2);
-                    resultV = convertV(concatenate(Vcell[1], Vcell[0]));
-
-                    // Read Average Current
-                    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x0B, 2); // average current over last 5 seconds
-                    CopyArray(ReceiveBuffer, AvgCurrent, 2);
-                    resultCurrent = convertCurrent(concatenate(AvgCurrent[1], AvgCurrent[0]));
-
-                if (resultSOC < thresholdSOC_hysteresis){ // check if threshold State of Charge has been reached
-                    MainMode = POWERSAVING;
-                    break;
-                }
-
-                // update display
-                uint8_t SoC_bar = resultSOC*28/100; // compute thickness of bar
-                uint32_t SoC_percentage = resultSOC;
-
-                lcd_fillRect(16,16,32,24,1);
-                lcd_fillRect(48,24,4,8,1);
-                lcd_fillRect(18,18,SoC_bar,20,0);
-
-                lcd_print_num(92,16,SoC_percentage,2,12);
-                lcd_print_char(110,16,'%',12,1);
-
-                if(resultCurrent&0x8000) {
-                    resultCurrent = complement(resultCurrent);
-                    lcd_print_string(68,28,"-",12);
-                    lcd_print_num(76,28,resultCurrent,4,12);
-                    lcd_print_string(104,28,"uA",12);
-                }
-                else {
-                    lcd_print_num(76,28,resultCurrent,4,12);
-                    lcd_print_string(104,28,"uA",12);
-                }
-                //lcd_print_num(76,28,resultV,4,12);
-                //lcd_print_string(104,28,"mV",12);
-
-                lcd_print_string(40,48,"Normal Mode",12);
-                lcd_fillRect(24,48,12,12,1);
-                lcd_print_string(40,64,"Power Saving",12);
-                lcd_fillRect(24,64,12,12,1);
-
-                lcd_print_num(28,88,gas,4,24);
-                lcd_print_string(80,88,"ppm",16);
-
-                lcd_fillRect(24,64,12,12,1); // normal mode
-                lcd_fillRect(26,50,8,8,0);
-
-                display_update(LCD_GRAM);
-
-                // go into LPM3 for 1 second
-                TA0CCTL0 |= CCIE;
-                TA0CCR0 = 32678; // 1s delay
-                TA0CTL |= TASSEL__ACLK | MC__UP;  // set clock to ACLK
-                __bis_SR_register(LPM3_bits + GIE);  // Enter LPM3 w/ interrupts
-                P2OUT ^= BIT0;
-                break;
 
-                    }
-                }
-        }
+//******************************************************************************
+// Cycle Functions *************************************************************
+//******************************************************************************
+
+LogRecord sample;
+
+// gauge registers the ladder and the display use, RepCap and RepSOC are
+// adjacent and come in one transfer
+typedef struct GaugeReadStruct{
+    uint8_t reg_addr;
+    uint8_t count;
+} GaugeRead;
+
+#define GAUGE_READS     4
+
+const GaugeRead GaugeRegs[GAUGE_READS] = {
+    {0x00, 2},      // Status
+    {0x05, 4},      // RepCap, RepSOC
+    {0x19, 2},      // VCell
+    {0x0B, 2}       // AvgCurrent, average over the last 5 seconds
+};
+uint8_t GaugeRx[GAUGE_READS][4];
+
+// takes over the staged gauge registers, returns 0 if the gauge was reset and
+// the reads have to be repeated
+uint8_t gauge_store(void){
+    CopyArray(GaugeRx[0], Status, 2);
+    StatusPOR[0] = Status[0] & 0x02;
+
+    if (StatusPOR[0]){ // gauge was reset, reload configuration
+        initializeConfig();
+        return 0;
+    }
+
+    CopyArray(GaugeRx[1], RepCAP, 2);
+    CopyArray(GaugeRx[1] + 2, RepSOC, 2);
+    resultCAP = convertCAP(concatenate(RepCAP[1], RepCAP[0]));
+    resultSOC = convertSOC(concatenate(RepSOC[1], RepSOC[0]));
+
+    CopyArray(GaugeRx[2], Vcell, 2);
+    resultV = convertV(concatenate(Vcell[1], Vcell[0]));
+
+    CopyArray(GaugeRx[3], AvgCurrent, 2);
+    resultCurrent = convertCurrent(concatenate(AvgCurrent[1], AvgCurrent[0]));
+    energy_window(resultCurrent);
+    return 1;
+}
+
+// one row per tier between the current and the CO2 reading, highest on top
+#define DISPLAY_MODE_Y      43
+#define DISPLAY_MODE_ROW    11
+typedef char DisplayModeRowsCheck[DISPLAY_MODE_Y + MODES * DISPLAY_MODE_ROW <= 88 ? 1 : -1]; // CO2 at y 88
+
+// draws the gauge readings into LCD_GRAM with a row per tier, the one in
+// mode ticked
+void display_render(Mode mode){
+    uint8_t i, y;
+
+    SoC_bar = resultSOC*28/100; // compute thickness of bar
+    SoC_percentage = resultSOC;
+
+    lcd_fillRect(16,16,32,24,1);
+    lcd_fillRect(48,24,4,8,1);
+    lcd_fillRect(18,18,SoC_bar,20,0);
+
+    lcd_print_num(92,16,SoC_percentage,2,12);
+    lcd_print_char(110,16,'%',12,1);
+
+    if(resultCurrent < 0) {
+        lcd_print_string(68,28,"-",12);
+        lcd_print_num(76,28,-resultCurrent,4,12);
+        lcd_print_string(104,28,"uA",12);
     }
+    else {
+        lcd_print_num(76,28,resultCurrent,4,12);
+        lcd_print_string(104,28,"uA",12);
+    }
+    //lcd_print_num(76,28,resultV,4,12);
+    //lcd_print_string(104,28,"mV",12);
+
+    for (i = 0; i < MODES; i++){
+        y = DISPLAY_MODE_Y + (MODES - 1 - i) * DISPLAY_MODE_ROW;
+        lcd_print_string(40,y,(const uint8_t *)ModeLadder[i].label,12);
+        lcd_fillRect(24,y+1,10,10,1);
+        if (i == mode)
+            lcd_fillRect(26,y+3,6,6,0);
+    }
+}
+
+// draws the CO2 reading, which arrives after the rest has been drawn
+void display_render_gas(void){
+    lcd_print_num(28,88,gas,4,24);
+    lcd_print_string(80,88,"ppm",16);
+}
+
+// hands the current readings to the FRAM log, mode is the tier they were
+// taken in
+void log_sample(Mode mode){
+    sample.co2 = (gas > 0xFFFF) ? 0xFFFF : (uint16_t)gas;
+    sample.temperature = temperature;
+    sample.vcell = resultV;
+    if (resultCurrent > 32767) sample.current = 32767;
+    else if (resultCurrent < -32767) sample.current = -32767;
+    else sample.current = (int16_t)resultCurrent;
+    sample.soc = (uint8_t)resultSOC;
+    sample.mode = mode;
+    if (fram_log_sample(&sample))
+        power_profile_save();   // counters go to FRAM with the log
 }
 
+
+
 //******************************************************************************
-// Interrupts ******************************************************************
+// Wake Tasks ******************************************************************
 //******************************************************************************
 
-// I2C interrupt service routine for STC31 and gauge
-#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
-#pragma vector = USCI_B0_VECTOR
-__interrupt void USCI_B0_ISR(void)
-#elif defined(__GNUC__)
-void __attribute__ ((interrupt(USCI_B0_VECTOR))) USCI_B0_ISR (void)
-#else
-#error Compiler not supported!
-#endif
-{
-  //Must read from UCB0RXBUF
-  uint8_t rx_val = 0;
-  switch(__even_in_range(UCB0IV, USCI_I2C_UCBIT9IFG))
-  {
-    case USCI_NONE:          break;         // Vector 0: No interrupts
-    case USCI_I2C_UCALIFG:   break;         // Vector 2: ALIFG
-    case USCI_I2C_UCNACKIFG:                // Vector 4: NACKIFG
-      break;
-    case USCI_I2C_UCSTTIFG:  break;         // Vector 6: STTIFG
-    case USCI_I2C_UCSTPIFG:  break;         // Vector 8: STPIFG
-    case USCI_I2C_UCRXIFG3:  break;         // Vector 10: RXIFG3
-    case USCI_I2C_UCTXIFG3:  break;         // Vector 12: TXIFG3
-    case USCI_I2C_UCRXIFG2:  break;         // Vector 14: RXIFG2
-    case USCI_I2C_UCTXIFG2:  break;         // Vector 16: TXIFG2
-    case USCI_I2C_UCRXIFG1:  break;         // Vector 18: RXIFG1
-    case USCI_I2C_UCTXIFG1:  break;         // Vector 20: TXIFG1
-    case USCI_I2C_UCRXIFG0:                 // Vector 22: RXIFG0
-        rx_val = UCB0RXBUF;
-        if (RXByteCtr)
-        {
-          ReceiveBuffer[ReceiveIndex++] = rx_val;
-          RXByteCtr--;
+// The work of one wake-up as three tasks (task.h), run in this order. The
+// STC31 conversions are started first; the gauge reads, the tier decision, the
+// drawing and the display lines without the CO2 reading go on while they
+// convert. The CO2 lines are sent once the result is in.
+
+Task SensorTask, GaugeTask, DisplayTask;
+
+uint8_t Sensing;        // set before the pass: measure in this cycle
+uint8_t SensorDone;     // gas and temperature are final
+uint16_t SensorReady;   // tick the conversion is done
+uint8_t Gauging;        // set before the pass: read the gauge in this cycle
+uint8_t GaugeIndex;
+uint8_t Rendering;      // the LCD is redrawn in this cycle
+uint8_t Drawn;          // MainMode is decided, LCD_GRAM is drawn
+uint8_t DisplayLine;
+
+TaskState sensor_task(Task *t){
+    TASK_BEGIN(t);
+    if (Sensing){
+        TASK_WAIT_UNTIL(t, task_i2c_idle());
+        ENERGY_BEGIN(ENERGY_SENSOR);
+        error = stc3x_start_all(GasSensors, GasSamples, GAS_SENSORS);
+        SensorReady = clock_ticks() + CLOCK_MS_TICKS(STC3X_MEASURE_US / 1000);
+        if (!error)
+            comp_start();   // converts within the STC31 window
+        ENERGY_END();
+
+        if (!error){
+            ENERGY_WAIT(ENERGY_SENSOR);
+            TASK_WAIT_UNTIL(t, task_reached(SensorReady));
+            TASK_WAIT_UNTIL(t, task_i2c_idle());
+            ENERGY_DONE(ENERGY_SENSOR);
+            ENERGY_BEGIN(ENERGY_SENSOR);
+            error = stc3x_read_all(GasSensors, GasSamples, GAS_SENSORS);
+            comp_update(GasSensors, GAS_SENSORS);  // for the next measurement
+            ENERGY_END();
+            if (GasSamples[0].error) {
+                //P2OUT = 0x01;
+            } else {
+                gas = convertGas(GasSamples[0].gas_ticks);
+                temperature = convertTemperature(GasSamples[0].temperature_ticks);
+            }
         }
+    }
+    SensorDone = 1;
+    TASK_END(t);
+}
 
-        if (RXByteCtr == 1)
-        {
-          UCB0CTLW0 |= UCTXSTP;
+TaskState gauge_task(Task *t){
+    Mode next;      // only used between two waits
+
+    TASK_BEGIN(t);
+    while (Gauging){
+        for (GaugeIndex = 0; GaugeIndex < GAUGE_READS; GaugeIndex++){
+            TASK_WAIT_UNTIL(t, task_i2c_idle());
+            ENERGY_BEGIN(ENERGY_GAUGE);
+            I2C_Master_ReadStart(SLAVE_ADDR_MAX17260, GaugeRegs[GaugeIndex].reg_addr,
+                                 GaugeRegs[GaugeIndex].count);
+            ENERGY_END();
+            ENERGY_WAIT(ENERGY_GAUGE);
+            TASK_WAIT_UNTIL(t, task_i2c_idle());
+            ENERGY_DONE(ENERGY_GAUGE);
+            TRACE_EVENT(TRACE_I2C_STOP, SLAVE_ADDR_MAX17260);
+            ENERGY_BEGIN(ENERGY_GAUGE);
+            if (I2CBus.mode == IDLE_MODE)   // keeps the last value on a NACK
+                CopyArray(I2CBus.rx_buffer, GaugeRx[GaugeIndex], GaugeRegs[GaugeIndex].count);
+            ENERGY_END();
         }
-        else if (RXByteCtr == 0)
-        {
-          UCB0IE &= ~UCRXIE;
-          MasterMode = IDLE_MODE;
-          __bic_SR_register_on_exit(CPUOFF);      // Exit LPM0
+        Gauging = !gauge_store();
+    }
+
+    // a frozen tier gets one frame when it is entered, which shows its row
+    next = mode_next(MainMode);
+    Rendering = (next != MainMode) || ModeLadder[next].display == DISPLAY_UPDATE;
+    MainMode = next;
+    boot_done();
+
+    // the buses are idle here, the sensor task only waits for its deadline
+    if (Rendering){
+        clock_set(CLOCK_FAST_MHZ);
+        ENERGY_BEGIN(ENERGY_RENDER);
+        display_render(MainMode);
+        ENERGY_END();
+        clock_set(CLOCK_BUS_MHZ);
+    }
+    Drawn = 1;
+    TASK_END(t);
+}
+
+TaskState display_task(Task *t){
+    TASK_BEGIN(t);
+    TASK_WAIT_UNTIL(t, Drawn);
+    if (!Rendering)
+        TASK_EXIT(t);
+
+    // the frame is in flight from its start to its end, the waits between
+    // the lines count for the display
+    ENERGY_WAIT(ENERGY_DISPLAY);
+    ENERGY_BEGIN(ENERGY_DISPLAY);
+    display_frame_start();
+    ENERGY_END();
+    for (DisplayLine = 0; DisplayLine < LINE; DisplayLine++){
+        if (DisplayLine == DISPLAY_GAS_FIRST)
+            DisplayLine = DISPLAY_GAS_END;
+        TASK_WAIT_UNTIL(t, task_spi_idle());
+        ENERGY_BEGIN(ENERGY_DISPLAY);
+        display_line_start(LCD_GRAM[0], DisplayLine);
+        ENERGY_END();
+    }
+
+    // CS stays up, the CO2 lines go out in the same frame
+    TASK_WAIT_UNTIL(t, SensorDone);
+    ENERGY_BEGIN(ENERGY_RENDER);
+    display_render_gas();
+    ENERGY_END();
+    for (DisplayLine = DISPLAY_GAS_FIRST; DisplayLine < DISPLAY_GAS_END; DisplayLine++){
+        TASK_WAIT_UNTIL(t, task_spi_idle());
+        ENERGY_BEGIN(ENERGY_DISPLAY);
+        display_line_start(LCD_GRAM[0], DisplayLine);
+        ENERGY_END();
+    }
+    TASK_WAIT_UNTIL(t, task_spi_idle());
+    ENERGY_BEGIN(ENERGY_DISPLAY);
+    display_frame_end();
+    ENERGY_END();
+    ENERGY_DONE(ENERGY_DISPLAY);
+    TASK_END(t);
+}
+
+int main(void){
+    uint16_t slept = 0, sensor_ready = 0;
+
+    WDTCTL = WDTPW | WDTHOLD;   // Stop watchdog timer
+    deep_sleep_woke();          // reads the reset reason first
+    clock_timer_start();        // boot clock and sleep timer
+    initClockTo16MHz();
+    initGPIO();
+    if (deep_sleep_woke()){
+        slept = deep_sleep_elapsed(); // before anything enables interrupts
+    }
+    xt1_start();                // starts up during the device configuration
+    initSPI();
+    initI2C();
+    if (!deep_sleep_woke()){
+        sensor_ready = boot_devices();
+    }
+    xt1_wait();
+    timebase_init();
+
+    if (deep_sleep_woke()){
+        // back from LPM3.5, the sensor and the gauge kept their settings
+        context_restore();
+        fram_log_resume();
+        fram_log_tick(slept);
+    }
+    else {
+        fram_log_init();
+    }
+    uart_export_init();
+    if (!deep_sleep_woke()){
+        clock_sleep_until(sensor_ready);
+    }
+
+    while(1){
+        const ModeTier *tier = &ModeLadder[MainMode];
+        Mode cycle_mode;
+        uint8_t waiting;
+
+        power_profile_cycle(MainMode);
+        TRACE_EVENT(TRACE_CYCLE, MainMode);
+        clock_set(CLOCK_BUS_MHZ);   // sensor and gauge are bus bound
+
+        // the STC31 is only powered in tiers that measure
+        if (tier->sensor && !SensorPower){
+            clock_sleep_until(sensor_wake());
         }
-        break;
-    case USCI_I2C_UCTXIFG0:                 // Vector 24: TXIFG0
-        switch (MasterMode)
-        {
-          case TX_REG_ADDRESS_MODE:
-              UCB0TXBUF = TransmitRegAddr;
-              if (RXByteCtr)
-                  MasterMode = SWITCH_TO_RX_MODE;   // Need to start receiving now
-              else
-                  MasterMode = TX_DATA_MODE;        // Continue to transmission with the data in Transmit Buffer
-              break;
-
-          case SWITCH_TO_RX_MODE:
-              UCB0IE |= UCRXIE;              // Enable RX interrupt
-              UCB0IE &= ~UCTXIE;             // Disable TX interrupt
-              UCB0CTLW0 &= ~UCTR;            // Switch to receiver
-              MasterMode = RX_DATA_MODE;    // State state is to receive data
-              UCB0CTLW0 |= UCTXSTT;          // Send repeated start
-              if (RXByteCtr == 1)
-              {
-                  //Must send stop since this is the N-1 byte
-                  while((UCB0CTLW0 & UCTXSTT));
-                  UCB0CTLW0 |= UCTXSTP;      // Send stop condition
-              }
-              break;
-
-          case TX_DATA_MODE:
-              if (TXByteCtr)
-              {
-                  UCB0TXBUF = TransmitBuffer[TransmitIndex++];
-                  TXByteCtr--;
-              }
-              else
-              {
-                  //Done with transmission
-                  UCB0CTLW0 |= UCTXSTP;     // Send stop condition
-                  MasterMode = IDLE_MODE;
-                  UCB0IE &= ~UCTXIE;                       // disable TX interrupt
-                  __bic_SR_register_on_exit(CPUOFF);      // Exit LPM0
-              }
-              break;
-
-          default:
-              __no_operation();
-              break;
+        else if (!tier->sensor && SensorPower){
+            sensor_power(0);
         }
-        break;
-    default: break;
-  }
-}
 
+        // One wake burst, the tasks take turns until all are done and the
+        // CPU sleeps whenever all of them wait
+        cycle_mode = MainMode;
+        Sensing = tier->sensor;
+        SensorDone = 0;
+        Gauging = 0;
+        if (++GaugeSkip >= tier->gauge_every){
+            GaugeSkip = 0;
+            Gauging = 1;
+        }
+        Drawn = 0;
+        TASK_INIT(&SensorTask);
+        TASK_INIT(&GaugeTask);
+        TASK_INIT(&DisplayTask);
+        event_open();
+        do {
+            waiting = (sensor_task(&SensorTask) == TASK_WAITING);
+            waiting |= (gauge_task(&GaugeTask) == TASK_WAITING);
+            waiting |= (display_task(&DisplayTask) == TASK_WAITING);
+            if (waiting)
+                task_idle();
+        } while (waiting);
+        event_close();
+        tier = &ModeLadder[MainMode];
+
+        log_sample(cycle_mode);
+
+        // long sleeps in LPM3.5 unless the host is using the UART export
+        if (uart_export_busy()) DeepHold = DEEP_HOLD_CYCLES;
+        else if (DeepHold) DeepHold--;
+        if (DEEP_SLEEP && tier->deep && !DeepHold &&
+            tier->period_ms >= DEEP_SLEEP_MIN_S * 1000U){
+            context_sleep(tier->period_ms / 1000);
+            // did not sleep, an interrupt was pending: this period in LPM3
+        }
 
-// SPI ISR
-#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
-#pragma vector=USCI_A1_VECTOR
-__interrupt void USCI_A1_ISR(void)
-#elif defined(__GNUC__)
-void __attribute__ ((interrupt(USCI_A1_VECTOR))) USCI_A1_ISR (void)
-#else
-#error Compiler not supported!
-#endif
-{
-    uint8_t uca1_rx_val = 0;
-    switch(__even_in_range(UCA1IV, USCI_SPI_UCTXIFG))
-    {
-        case USCI_NONE: break;
-        case USCI_SPI_UCRXIFG:
-            uca1_rx_val = UCA1RXBUF;
-            UCA1IFG &= ~UCRXIFG;
-            switch (MasterMode)
-            {
-                case TX_REG_ADDRESS_MODE:
-                    if (RXByteCtr)
-                    {
-                        // Need to start receiving now
-                        MasterMode = RX_DATA_MODE;
-
-                        // Send dummy byte to start
-                        __delay_cycles(5000);
-                        SendUCA1Data(DUMMY);
-                    }
-                    else
-                    {
-                        // Continue to transmission
-                        MasterMode = TX_DATA_MODE;
-
-                        // Send first byte
-                        SendUCA1Data(TransmitBuffer[TransmitIndex++]);
-                        TXByteCtr--;
-                    }
-                    break;
-
-                case TX_DATA_MODE:
-                    if (TXByteCtr)
-                    {
-                        // Send additional byte
-                        SendUCA1Data(TransmitBuffer[TransmitIndex++]);
-                        TXByteCtr--;
-                    }
-                    else
-                    {
-                        // Done with transmission
-                        MasterMode = IDLE_MODE;
-                        __bic_SR_register_on_exit(CPUOFF);  // Exit LPM0
-                    }
-                    break;
-
-                case RX_DATA_MODE:
-                    if (RXByteCtr)
-                    {
-                        // Store received byte
-                        ReceiveBuffer[ReceiveIndex++] = uca1_rx_val;
-                        RXByteCtr--;
-                    }
-                    if (RXByteCtr == 0)
-                    {
-                        // Done with reception
-                        MasterMode = IDLE_MODE;
-                        __bic_SR_register_on_exit(CPUOFF);  // Exit LPM0
-                    }
-                    else
-                    {
-                        // Send dummy byte to receive next byte
-                        SendUCA1Data(DUMMY);
-                    }
-                    break;
-
-                default:
-                    __no_operation();
-                    break;
-            }
-            __delay_cycles(1000);
-            break;
-        case USCI_SPI_UCTXIFG:
-            break;
-        default: break;
+        // go into LPM3 for the tier period
+        clock_set(CLOCK_FAST_MHZ);  // UART export runs during the sleep
+        ENERGY_BEGIN(ENERGY_SLEEP);
+        mode_sleep(tier->period_ms);
+        ENERGY_END();
+        LogMs += tier->period_ms;
+        fram_log_tick(LogMs / 1000);
+        LogMs %= 1000;
     }
 }
 
+//******************************************************************************
+// Interrupts ******************************************************************
+//******************************************************************************
 
 // Timer0 interrupt service routine
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
@@ -0,0 +1,43 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "boot.h"
+#include "clock.h"
+#include "deep_sleep.h"
+#include "fram.h"
+
+
+//******************************************************************************
+// Persistent Storage **********************************************************
+//******************************************************************************
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(Boot)
+#endif
+FRAM_PERSISTENT BootTime Boot = {0, 0};
+
+
+//******************************************************************************
+// Boot Functions **************************************************************
+//******************************************************************************
+
+// records the time since clock_timer_start() on the first call, later calls
+// return at once
+void boot_done(void)
+{
+    static uint8_t done = 0;
+    uint16_t ms;
+
+    if (done)
+        return;
+    done = 1;
+    ms = (uint16_t)(clock_ticks() * 1000UL / CLOCK_TICK_HZ);
+
+    FRAM_WRITE_ENABLE();
+    if (deep_sleep_woke())
+        Boot.wake_ms = ms;
+    else
+        Boot.cold_ms = ms;
+    FRAM_WRITE_DISABLE();
+}
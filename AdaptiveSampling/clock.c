@@ -0,0 +1,217 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "clock.h"
+#include "power_profile.h"
+#include "event.h"
+
+volatile uint8_t ClockMHz = 16;     // initClockTo16MHz() leaves MCLK at the DCO
+
+
+//******************************************************************************
+// Peripheral Dividers *********************************************************
+//******************************************************************************
+
+// eUSCI_B0 I2C, waits for the stop condition of the last transfer
+static void clock_update_i2c(void)
+{
+    uint16_t ie;
+
+    if ((UCB0CTLW0 & UCSSEL_3) != UCSSEL__SMCLK)
+        return;
+    while (UCB0STATW & UCBBUSY);
+    ie = UCB0IE;                    // UCSWRST clears the interrupt enables
+    UCB0CTLW0 |= UCSWRST;
+    UCB0BRW = CLOCK_DIVIDER(CLOCK_I2C_HZ);
+    UCB0CTLW0 &= ~UCSWRST;
+    UCB0IE = ie;
+}
+
+// eUSCI_A1 SPI display
+static void clock_update_spi(void)
+{
+    uint16_t ie;
+
+    if ((UCA1CTLW0 & UCSSEL_3) != UCSSEL__SMCLK)
+        return;
+    while (UCA1STATW & UCBUSY);
+    ie = UCA1IE;
+    UCA1CTLW0 |= UCSWRST;
+    UCA1BRW = CLOCK_DIVIDER(CLOCK_SPI_HZ);
+    UCA1CTLW0 &= ~UCSWRST;
+    UCA1IE = ie;
+}
+
+// 1 while eUSCI_A0 runs from SMCLK and a byte is on the line or a response
+// is still going out (UCTXIE stays set until its last frame is sent)
+static uint8_t clock_uart_busy(void)
+{
+    if ((UCA0CTLW0 & UCSSEL_3) != UCSSEL__SMCLK)
+        return 0;
+    return (UCA0IE & UCTXIE) || (UCA0STATW & UCBUSY);
+}
+
+// eUSCI_A0 UART, oversampling while SMCLK allows it
+static void clock_update_uart(void)
+{
+    uint16_t ie, n;
+
+    if ((UCA0CTLW0 & UCSSEL_3) != UCSSEL__SMCLK)
+        return;
+    ie = UCA0IE;
+    n = CLOCK_DIVIDER(CLOCK_UART_BAUD);
+    UCA0CTLW0 |= UCSWRST;
+    if (n >= 16) {
+        UCA0BRW = n / 16;
+        UCA0MCTLW = UCOS16;
+    } else {
+        UCA0BRW = n;
+        UCA0MCTLW = 0;
+    }
+    UCA0CTLW0 &= ~UCSWRST;
+    UCA0IE = ie;
+    if (ie & UCTXIE)
+        UCA0IFG |= UCTXIFG;         // the reset dropped the pending byte
+}
+
+
+//******************************************************************************
+// Clock Functions *************************************************************
+//******************************************************************************
+
+// switches MCLK = SMCLK to 16, 8, 4, 2 or 1 MHz, at least CLOCK_UART_MIN_MHZ
+// while the UART runs from SMCLK. While the UART is sending the clock stays
+// as it is, the next call switches.
+void clock_set(uint8_t mhz)
+{
+    uint16_t divm, state;
+
+    if (mhz < CLOCK_UART_MIN_MHZ && (UCA0CTLW0 & UCSSEL_3) == UCSSEL__SMCLK)
+        mhz = CLOCK_UART_MIN_MHZ;
+    if (mhz == ClockMHz)
+        return;
+
+    switch (mhz) {
+        case 16: divm = DIVM__1; break;
+        case 8:  divm = DIVM__2; break;
+        case 4:  divm = DIVM__4; break;
+        case 2:  divm = DIVM__8; break;
+        default: divm = DIVM__16; mhz = 1; break;
+    }
+
+    // no response may start between the check and the UART reset
+    state = __get_interrupt_state();
+    __disable_interrupt();
+    if (clock_uart_busy()) {
+        __set_interrupt_state(state);
+        return;
+    }
+    if (mhz > 8)
+        FRCTL0 = FRCTLPW | NWAITS_1;        // wait state before speeding up
+    CSCTL5 = (CSCTL5 & ~DIVM_7) | divm;
+    if (mhz <= 8)
+        FRCTL0 = FRCTLPW | NWAITS_0;        // and dropped after slowing down
+    ClockMHz = mhz;
+    clock_update_uart();
+    __set_interrupt_state(state);
+
+    clock_update_i2c();
+    clock_update_spi();
+}
+
+void clock_delay_ms(uint16_t ms)
+{
+    while (ms--)
+        CLOCK_DELAY_US(1000);
+}
+
+
+//******************************************************************************
+// Sleep Timer *****************************************************************
+//******************************************************************************
+
+// TA2 free running from ACLK / 8, first thing in main()
+void clock_timer_start(void)
+{
+    TA2CCTL1 = 0;
+    TA2CTL = TASSEL__ACLK | ID__8 | MC__CONTINUOUS | TACLR;
+}
+
+// TA2R counts asynchronously to MCLK, two equal reads are a valid one
+uint16_t clock_ticks(void)
+{
+    uint16_t last, now = TA2R;
+
+    do {
+        last = now;
+        now = TA2R;
+    } while (now != last);
+    return now;
+}
+
+// 1 once TA2 has passed tick, valid up to 8 s either side
+uint8_t clock_reached(uint16_t tick)
+{
+    return (int16_t)(clock_ticks() - tick) >= 0;
+}
+
+// TA2 CCR1 ends the current or next LPM when TA2 reaches tick
+void clock_wake_at(uint16_t tick)
+{
+    TA2CCR1 = tick;
+    TA2CCTL1 = CCIE;
+}
+
+void clock_wake_off(void)
+{
+    TA2CCTL1 = 0;
+}
+
+// LPM3 until TA2 reaches tick, returns at once if it already has
+void clock_sleep_until(uint16_t tick)
+{
+    __disable_interrupt();
+    clock_wake_at(tick);
+    while (!clock_reached(tick)) {
+        POWER_PROFILE_SLEEP(POWER_LPM3, LPM3_bits + GIE);
+        __disable_interrupt();
+    }
+    clock_wake_off();
+    __enable_interrupt();
+}
+
+void clock_sleep_ms(uint16_t ms)
+{
+    while (ms > CLOCK_SLEEP_MAX_MS) {
+        clock_sleep_until(clock_ticks() + CLOCK_MS_TICKS(CLOCK_SLEEP_MAX_MS));
+        ms -= CLOCK_SLEEP_MAX_MS;
+    }
+    if (ms)
+        clock_sleep_until(clock_ticks() + CLOCK_MS_TICKS(ms));
+}
+
+
+//******************************************************************************
+// Interrupts ******************************************************************
+//******************************************************************************
+
+// Timer2 CCR1, end of a clock_sleep_until() or a clock_wake_at()
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = TIMER2_A1_VECTOR
+__interrupt void Timer2_A1 (void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(TIMER2_A1_VECTOR))) Timer2_A1 (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    switch(__even_in_range(TA2IV, TAIV__TAIFG))
+    {
+        case TAIV__TACCR1:
+            event_post(EVENT_CLOCK, 0);
+            __bic_SR_register_on_exit(LPM3_bits);     // Exit LPM
+            break;
+        default: break;
+    }
+}
@@ -0,0 +1,71 @@
+//******************************************************************************
+
+#include <stdint.h>
+#include "cobs.h"
+
+
+// encodes length bytes, out needs length + COBS_MAX_OVERHEAD(length) bytes.
+// Returns the encoded length, the delimiter is not appended.
+uint16_t cobs_encode(const uint8_t *in, uint16_t length, uint8_t *out)
+{
+    uint16_t code_index = 0;
+    uint16_t out_index = 1;
+    uint8_t code = 1;
+    uint16_t i;
+
+    for (i = 0; i < length; i++) {
+        if (in[i] == 0) {
+            out[code_index] = code;
+            code_index = out_index++;
+            code = 1;
+        } else {
+            out[out_index++] = in[i];
+            if (++code == 0xFF) {
+                out[code_index] = code;
+                code_index = out_index++;
+                code = 1;
+            }
+        }
+    }
+    out[code_index] = code;
+    return out_index;
+}
+
+// decodes one frame without its delimiter, returns the payload length or 0 if
+// the frame is malformed
+uint16_t cobs_decode(const uint8_t *in, uint16_t length, uint8_t *out)
+{
+    uint16_t in_index = 0;
+    uint16_t out_index = 0;
+    uint8_t code, i;
+
+    while (in_index < length) {
+        code = in[in_index++];
+        if (code == 0 || in_index + code - 1 > length)
+            return 0;
+        for (i = 1; i < code; i++)
+            out[out_index++] = in[in_index++];
+        if (code != 0xFF && in_index < length)
+            out[out_index++] = 0;
+    }
+    return out_index;
+}
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, init 0xFFFF
+uint16_t crc16_ccitt(const uint8_t *data, uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+    uint16_t i;
+    uint8_t bit;
+
+    for (i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (bit = 0; bit < 8; bit++) {
+            if (crc & 0x8000)
+                crc = (crc << 1) ^ 0x1021;
+            else
+                crc = crc << 1;
+        }
+    }
+    return crc;
+}
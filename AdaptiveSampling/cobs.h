@@ -0,0 +1,23 @@
+//******************************************************************************
+// COBS Framing and CRC ********************************************************
+//******************************************************************************
+//
+// Consistent overhead byte stuffing: the encoded frame contains no 0x00, so a
+// single 0x00 delimits frames on the wire and a receiver resynchronizes on the
+// next delimiter after any error. Frames carry a CRC-16/CCITT-FALSE over the
+// payload, appended little endian before encoding.
+//
+// Only depends on <stdint.h>, it is also built into the host tools.
+
+#ifndef COBS_H
+#define COBS_H
+
+#include <stdint.h>
+
+#define COBS_MAX_OVERHEAD(n)    ((n) / 254 + 1)
+
+uint16_t cobs_encode(const uint8_t *in, uint16_t length, uint8_t *out);
+uint16_t cobs_decode(const uint8_t *in, uint16_t length, uint8_t *out);
+uint16_t crc16_ccitt(const uint8_t *data, uint16_t length);
+
+#endif /* COBS_H */
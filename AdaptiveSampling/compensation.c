@@ -0,0 +1,195 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "compensation.h"
+#include "sensirion_common.h"
+#include "sensirion_i2c.h"
+#include "fram.h"
+
+#define COMP_USES_SHT4X     (COMP_HUMIDITY_SOURCE == COMP_SOURCE_SHT4X || \
+                             COMP_TEMPERATURE_SOURCE == COMP_SOURCE_SHT4X)
+
+#define SHT4X_MEASURE_HIGH  0xFD
+
+typedef enum CompQuantityEnum{
+    COMP_HUMIDITY,
+    COMP_TEMPERATURE,
+    COMP_PRESSURE,
+    COMP_QUANTITIES
+} CompQuantity;
+
+typedef int16_t (*CompSetter)(const Stc3x* sensor, uint16_t value);
+
+static const CompSetter CompSet[COMP_QUANTITIES] = {
+    stc3x_set_relative_humidity,
+    stc3x_set_temperature,
+    stc3x_set_pressure
+};
+
+
+//******************************************************************************
+// Persistent Storage **********************************************************
+//******************************************************************************
+
+// what the sensors compensate with, valid where the written bit is set
+typedef struct CompStateStruct{
+    uint16_t value[COMP_QUANTITIES];
+    uint8_t written;        // bit per CompQuantity
+} CompState;
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(Comp)
+#endif
+FRAM_PERSISTENT CompState Comp = {{0}, 0};
+
+#if COMP_USES_SHT4X
+static uint8_t Sht4xStarted = 0;
+#endif
+
+
+//******************************************************************************
+// Sensor Updates **************************************************************
+//******************************************************************************
+
+// writes value to every sensor unless they have it within deadband already
+static int16_t comp_apply(CompQuantity quantity, uint16_t value,
+                          uint16_t deadband, const Stc3x* sensors, uint8_t count)
+{
+    int16_t error = NO_ERROR, result;
+    uint16_t distance;
+    uint8_t i;
+
+    if (quantity == COMP_TEMPERATURE) {     // signed ticks
+        int16_t d = (int16_t)value - (int16_t)Comp.value[quantity];
+        distance = (d < 0) ? -d : d;
+    } else {
+        distance = (value > Comp.value[quantity]) ?
+                   value - Comp.value[quantity] : Comp.value[quantity] - value;
+    }
+    if ((Comp.written & (1 << quantity)) && distance <= deadband)
+        return NO_ERROR;
+
+    for (i = 0; i < count; i++) {
+        result = CompSet[quantity](&sensors[i], value);
+        if (result)
+            error = result;
+    }
+    if (error)
+        return error;   // tried again on the next update
+
+    FRAM_WRITE_ENABLE();
+    Comp.value[quantity] = value;
+    Comp.written |= 1 << quantity;
+    FRAM_WRITE_DISABLE();
+    return NO_ERROR;
+}
+
+#if COMP_USES_SHT4X
+// reads the SHT4x started by comp_start(), in STC3x ticks
+static int16_t sht4x_read(uint16_t* humidity, uint16_t* temperature)
+{
+    uint8_t buffer[6];
+    uint32_t ticks;
+    int32_t rh;
+    int16_t error;
+
+    error = sensirion_i2c_read_data_inplace(COMP_SHT4X_ADDRESS, &buffer[0], 4);
+    if (error)
+        return error;
+
+    // T = -45 + 175 * S / 2^16 degC, times 200
+    ticks = sensirion_common_bytes_to_uint16_t(&buffer[0]);
+    *temperature = (uint16_t)((int16_t)((ticks * 35000 + 32768) >> 16) - 9000);
+    // RH = -6 + 125 * S / 2^16 %, times 65535 / 100
+    rh = (int32_t)sensirion_common_bytes_to_uint16_t(&buffer[2]);
+    rh = rh + (rh >> 2) - 3932;
+    if (rh < 0)
+        rh = 0;
+    else if (rh > 65535)
+        rh = 65535;
+    *humidity = (uint16_t)rh;
+    return NO_ERROR;
+}
+#endif
+
+
+//******************************************************************************
+// Compensation Functions ******************************************************
+//******************************************************************************
+
+// after a cold boot the sensors have their defaults, writes the constants.
+// An SHT4x humidity starts from the constant until its first reading.
+int16_t comp_boot(const Stc3x* sensors, uint8_t count)
+{
+    int16_t error = NO_ERROR, result;
+
+    FRAM_WRITE_ENABLE();
+    Comp.written = 0;
+    FRAM_WRITE_DISABLE();
+
+    result = comp_apply(COMP_HUMIDITY, COMP_HUMIDITY_CONSTANT, 0, sensors, count);
+    if (result)
+        error = result;
+#if COMP_TEMPERATURE_SOURCE == COMP_SOURCE_CONSTANT
+    result = comp_apply(COMP_TEMPERATURE, COMP_TEMPERATURE_CONSTANT, 0, sensors, count);
+    if (result)
+        error = result;
+#endif
+    result = comp_apply(COMP_PRESSURE, COMP_PRESSURE_CONSTANT, 0, sensors, count);
+    if (result)
+        error = result;
+    return error;
+}
+
+// call right after the STC31 conversions were started
+int16_t comp_start(void)
+{
+#if COMP_USES_SHT4X
+    const uint8_t command = SHT4X_MEASURE_HIGH;
+    int16_t error;
+
+    error = sensirion_i2c_write_data(COMP_SHT4X_ADDRESS, &command, 1);
+    Sht4xStarted = !error;
+    return error;
+#else
+    return NO_ERROR;
+#endif
+}
+
+// call after the STC31 results were read, writes what has moved beyond its
+// deadband. With constant sources only a failed write is retried. Without an
+// SHT4x reading its quantities keep their last values.
+int16_t comp_update(const Stc3x* sensors, uint8_t count)
+{
+    uint16_t humidity = COMP_HUMIDITY_CONSTANT;
+    uint16_t temperature = COMP_TEMPERATURE_CONSTANT;
+    int16_t error = NO_ERROR, result;
+    uint8_t measured = 0;
+
+#if COMP_USES_SHT4X
+    if (Sht4xStarted) {
+        Sht4xStarted = 0;
+        error = sht4x_read(&humidity, &temperature);
+        measured = !error;
+    }
+#endif
+
+    if (COMP_HUMIDITY_SOURCE == COMP_SOURCE_CONSTANT || measured) {
+        result = comp_apply(COMP_HUMIDITY, humidity, COMP_HUMIDITY_DEADBAND,
+                            sensors, count);
+        if (result)
+            error = result;
+    }
+    if (COMP_TEMPERATURE_SOURCE == COMP_SOURCE_CONSTANT ||
+        (COMP_TEMPERATURE_SOURCE == COMP_SOURCE_SHT4X && measured)) {
+        result = comp_apply(COMP_TEMPERATURE, temperature,
+                            COMP_TEMPERATURE_DEADBAND, sensors, count);
+        if (result)
+            error = result;
+    }
+    result = comp_apply(COMP_PRESSURE, COMP_PRESSURE_CONSTANT, 0, sensors, count);
+    if (result)
+        error = result;
+    return error;
+}
@@ -0,0 +1,60 @@
+//******************************************************************************
+// STC31 Compensation **********************************************************
+//******************************************************************************
+//
+// Keeps the humidity, temperature and pressure the STC31s compensate with
+// close to the real values. Each quantity has a source chosen at build time:
+//   COMP_SOURCE_CONSTANT  the COMP_*_CONSTANT value below
+//   COMP_SOURCE_STC31     temperature only: the sensor's internal signal,
+//                         which it uses as long as no temperature is written
+//   COMP_SOURCE_SHT4X     an SHT4x on the same bus (COMP_SHT4X_ADDRESS)
+// A value goes to the sensors only when it differs from the one they have by
+// more than its deadband; most cycles send nothing.
+//
+// The SHT4x rides on the STC31 measurement: comp_start() starts it right
+// after the STC31 conversions, comp_update() reads it after their results
+// and writes what has moved. A written value applies from the next
+// measurement. If the SHT4x does not acknowledge its start or its read (not
+// fitted, or still converting) the transfer ends with I2C_NACK_ERROR and
+// nothing is written, so the sensors go on with the last values: the last
+// reading, or after a cold boot the humidity constant and the STC31's own
+// temperature. The values the sensors have are kept in FRAM, the STC31s keep
+// them over LPM3.5; comp_boot() writes everything after a cold boot.
+
+#ifndef COMPENSATION_H
+#define COMPENSATION_H
+
+#include <stdint.h>
+#include "stc3x_i2c.h"
+
+#define COMP_SOURCE_CONSTANT    0
+#define COMP_SOURCE_STC31       1
+#define COMP_SOURCE_SHT4X       2
+
+#ifndef COMP_HUMIDITY_SOURCE
+#define COMP_HUMIDITY_SOURCE    COMP_SOURCE_CONSTANT
+#endif
+#ifndef COMP_TEMPERATURE_SOURCE
+#define COMP_TEMPERATURE_SOURCE COMP_SOURCE_STC31
+#endif
+
+// STC3x ticks: RH * 65535 / 100, T * 200, mbar
+#define COMP_HUMIDITY_CONSTANT      38767   // 60% rel. humidity (32767 = 50%)
+#define COMP_TEMPERATURE_CONSTANT   5000    // 25 degC
+#define COMP_PRESSURE_CONSTANT      980     // mbar
+
+#define COMP_HUMIDITY_DEADBAND      1311    // 2% RH
+#define COMP_TEMPERATURE_DEADBAND   100     // 0.5 degC
+
+#define COMP_SHT4X_ADDRESS          0x44
+#define COMP_SHT4X_MEASURE_US       8300    // high repeatability
+
+#if COMP_HUMIDITY_SOURCE == COMP_SOURCE_STC31
+#error The STC31 has no humidity signal
+#endif
+
+int16_t comp_boot(const Stc3x* sensors, uint8_t count);
+int16_t comp_start(void);
+int16_t comp_update(const Stc3x* sensors, uint8_t count);
+
+#endif /* COMPENSATION_H */
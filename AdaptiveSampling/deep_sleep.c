@@ -0,0 +1,63 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "deep_sleep.h"
+
+#define RTC_TICKS_PER_S     32      // XT1 / 1024
+
+
+//******************************************************************************
+// Deep Sleep Functions ********************************************************
+//******************************************************************************
+
+// 1 when this start is a wake-up from LPM3.5. Reads SYSRSTIV, so it has to be
+// the first call after reset; later calls return the same answer.
+uint8_t deep_sleep_woke(void)
+{
+    static uint8_t checked = 0, woke = 0;
+    uint16_t reason;
+
+    if (!checked) {
+        checked = 1;
+        while ((reason = SYSRSTIV) != SYSRSTIV_NONE)
+            if (reason == SYSRSTIV_LPM5WU)
+                woke = 1;
+    }
+    return woke;
+}
+
+// arms the RTC and enters LPM3.5, wake-up sources on P1/P2 must be enabled by
+// the caller. Only returns if an interrupt was pending, without having slept.
+void deep_sleep(uint16_t seconds)
+{
+    if (seconds > DEEP_SLEEP_MAX_S)
+        seconds = DEEP_SLEEP_MAX_S;
+
+    RTCMOD = seconds * RTC_TICKS_PER_S - 1;
+    RTCCTL = RTCSS__XT1CLK | RTCSR | RTCPS__1024 | RTCIE;
+
+    __disable_interrupt();
+    PMMCTL0_H = PMMPW_H;
+    PMMCTL0_L |= PMMREGOFF;
+    PMMCTL0_H = 0;
+    __bis_SR_register(LPM3_bits | GIE);     // Enter LPM3.5 w/ interrupts
+
+    // an ISR ran first and cleared the LPM bits, back to plain LPM3 for later
+    PMMCTL0_H = PMMPW_H;
+    PMMCTL0_L &= ~PMMREGOFF;
+    PMMCTL0_H = 0;
+    RTCCTL = 0;
+}
+
+// after a wake-up, once the pins are unlocked: stops the RTC and returns the
+// seconds slept. The RTC flag is cleared, so no RTC ISR follows.
+uint16_t deep_sleep_elapsed(void)
+{
+    uint16_t ticks = RTCCNT;
+
+    if (RTCIV == RTCIV_RTCIF)
+        ticks = RTCMOD + 1;
+    RTCCTL = 0;
+    return ticks / RTC_TICKS_PER_S;
+}
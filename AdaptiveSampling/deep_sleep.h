@@ -0,0 +1,32 @@
+//******************************************************************************
+// LPM3.5 Deep Sleep ***********************************************************
+//******************************************************************************
+//
+// In LPM3.5 the core regulator is off: RAM and every peripheral except the
+// RTC and the P1/P2 wake-up logic lose power, and XT1 keeps running for the
+// RTC. Waking up is a reset. main() starts over with SYSRSTIV_LPM5WU and the
+// pins held in their sleep state (LOCKLPM5) until initGPIO() has configured
+// them again. The firmware checkpoints whatever it needs to FRAM before
+// deep_sleep() and restores it when deep_sleep_woke() says so.
+//
+// The instrumentation (timebase.h) needs TA3 and RAM through the sleep, so
+// DEEP_SLEEP defaults to 0 in those builds.
+
+#ifndef DEEP_SLEEP_H
+#define DEEP_SLEEP_H
+
+#include <stdint.h>
+#include "timebase.h"
+
+#ifndef DEEP_SLEEP
+#define DEEP_SLEEP      (!TIMEBASE)
+#endif
+
+#define DEEP_SLEEP_MIN_S    2       // shorter sleeps are not worth the boot
+#define DEEP_SLEEP_MAX_S    2047    // RTCMOD at XT1 / 1024
+
+uint8_t deep_sleep_woke(void);
+void deep_sleep(uint16_t seconds);
+uint16_t deep_sleep_elapsed(void);
+
+#endif /* DEEP_SLEEP_H */
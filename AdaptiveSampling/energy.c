@@ -0,0 +1,153 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "fram.h"
+#include "timebase.h"
+#include "energy.h"
+
+#if ENERGY
+
+#define ENERGY_TICKS_PER_NAH8   14746   // 32768 Hz * 3.6 nAh/uAs / 8
+#define ENERGY_WINDOW_MAX       (32 * TIMEBASE_HZ)  // longer windows are skipped
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(Energy)
+#endif
+FRAM_PERSISTENT EnergyTotals Energy = {{0}, 0, 0};
+
+// nominal current per subsystem in uA, only the ratios matter
+static const uint16_t EnergyWeight[ENERGY_SUBSYSTEMS] = {
+    2000,   // CPU: MCU active at 16 MHz
+    3100,   // SENSOR: STC31 measuring and its transfers
+    450,    // GAUGE: MCU in LPM0, bus and gauge active
+    2000,   // RENDER: MCU active
+    470,    // DISPLAY: MCU in LPM0, SPI and LCD update
+    12      // SLEEP: MCU in LPM3, gauge, LCD and STC31 idle
+};
+
+static uint32_t WindowTicks[ENERGY_SUBSYSTEMS];
+static uint32_t WindowTime = 0;     // ACLK ticks, overlaps count once
+static uint32_t LastStamp = 0;
+static uint16_t ChargeRest = 0;
+static uint8_t Current = ENERGY_CPU;
+static uint8_t Waiting = 0;         // bit per subsystem working without the CPU
+static uint8_t Idle = 0;            // CPU sleeps in task_idle()
+
+
+//******************************************************************************
+// Timing **********************************************************************
+//******************************************************************************
+
+// adds the time since the last switch to the running subsystem, or while
+// the CPU is idle to every subsystem waited on
+static void energy_account(void)
+{
+    uint32_t now = timebase_now();
+    uint32_t elapsed = now - LastStamp;
+    uint8_t i;
+
+    LastStamp = now;
+    WindowTime += elapsed;
+    if (!Idle || !Waiting) {
+        WindowTicks[Idle ? ENERGY_SLEEP : Current] += elapsed;
+        return;
+    }
+    for (i = 0; i < ENERGY_SUBSYSTEMS; i++) {
+        if (Waiting & (1 << i))
+            WindowTicks[i] += elapsed;
+    }
+}
+
+void energy_switch(uint8_t subsystem)
+{
+    energy_account();
+    Current = subsystem;
+}
+
+// marks a subsystem as working on while its task waits
+void energy_wait(uint8_t subsystem, uint8_t waiting)
+{
+    energy_account();
+    if (waiting)
+        Waiting |= 1 << subsystem;
+    else
+        Waiting &= ~(1 << subsystem);
+}
+
+// brackets the sleep in task_idle()
+void energy_idle(uint8_t idle)
+{
+    energy_account();
+    Idle = idle;
+}
+
+
+//******************************************************************************
+// Attribution *****************************************************************
+//******************************************************************************
+
+// splits the charge of the window since the last call, avg_current in uA
+// (negative while discharging, convertCurrent()). The weighted sum fits 32
+// bit: a tick counts for the running subsystem, or while idle for SENSOR,
+// GAUGE and DISPLAY at most, and 4020 x ENERGY_WINDOW_MAX < 2^32.
+void energy_window(int32_t avg_current)
+{
+    uint32_t weighted[ENERGY_SUBSYSTEMS];
+    uint32_t window, sum = 0, scale, fraction, charge, share, given = 0;
+    uint16_t whole, part;
+    uint8_t i, largest = ENERGY_CPU;
+
+    energy_account();
+    window = WindowTime;
+    for (i = 0; i < ENERGY_SUBSYSTEMS; i++) {
+        weighted[i] = WindowTicks[i] * EnergyWeight[i];
+        sum += weighted[i];
+        if (weighted[i] > weighted[largest])
+            largest = i;
+    }
+
+    if (avg_current < 0 && avg_current > -65536L && sum && window < ENERGY_WINDOW_MAX) {
+        // (window / 8) x current overflows 32 bit above 32 mA, so the window
+        // is split into whole ENERGY_TICKS_PER_NAH8 and the part below
+        whole = (uint16_t)((window >> 3) / ENERGY_TICKS_PER_NAH8);
+        part = (uint16_t)((window >> 3) % ENERGY_TICKS_PER_NAH8);
+        charge = (uint32_t)part * (uint32_t)(-avg_current) + ChargeRest;
+        ChargeRest = charge % ENERGY_TICKS_PER_NAH8;
+        charge = charge / ENERGY_TICKS_PER_NAH8 + (uint32_t)whole * (uint32_t)(-avg_current);
+        scale = (sum >> 16) + 1;    // brings the weights below 2^16
+
+        FRAM_WRITE_ENABLE();
+        for (i = 0; i < ENERGY_SUBSYSTEMS; i++) {
+            // share of the weights in 1/65536, times a charge of up to 20 bit
+            fraction = ((weighted[i] / scale) << 16) / (sum / scale);
+            share = fraction * (charge >> 16) + ((fraction * (charge & 0xFFFF)) >> 16);
+            Energy.nAh[i] += share;
+            given += share;
+        }
+        Energy.nAh[largest] += charge - given;  // rounding remainder
+        window += Energy.ticks;
+        Energy.seconds += window / TIMEBASE_HZ;
+        Energy.ticks = window % TIMEBASE_HZ;
+        FRAM_WRITE_DISABLE();
+    }
+
+    for (i = 0; i < ENERGY_SUBSYSTEMS; i++)
+        WindowTicks[i] = 0;
+    WindowTime = 0;
+}
+
+// average current of a subsystem over all attributed windows in uA, which is
+// the same number as its uAh per hour
+uint16_t energy_rate(uint8_t subsystem)
+{
+    uint32_t nAh = Energy.nAh[subsystem];
+
+    if (Energy.seconds == 0)
+        return 0;
+    if (nAh < 0xFFFFFFFFUL / 36)
+        return (uint16_t)(nAh * 36 / 10 / Energy.seconds);
+    return (uint16_t)(nAh / Energy.seconds * 36 / 10);
+}
+
+#endif /* ENERGY */
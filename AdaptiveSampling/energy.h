@@ -0,0 +1,77 @@
+//******************************************************************************
+// Energy Attribution **********************************************************
+//******************************************************************************
+//
+// Optional instrumentation, enabled with ENERGY=1 in the compiler defines.
+// The firmware marks which subsystem is running with ENERGY_BEGIN() and
+// ENERGY_END(); the time per subsystem is taken from the ACLK timebase (see
+// timebase.h). A section must end before its task waits, the other tasks run
+// in between. Work that goes on while the CPU sleeps in task_idle() (a bus
+// transfer, the STC31 conversion) lies between ENERGY_WAIT() and
+// ENERGY_DONE(); the idle time counts for every subsystem waited on, since
+// they draw current at the same time, and for SLEEP if there is none.
+//
+// Once per main loop energy_window() takes the MAX17260 AvgCurrent, turns it
+// into the charge used since the previous call and splits that charge over
+// the subsystems by time x nominal current (EnergyWeight in energy.c). The
+// gauge only gives one current per window, so the weights decide the split
+// and the measurement scales it to what the battery actually delivered.
+//
+// The running totals are kept in FRAM (Energy) and survive resets.
+// energy_rate() returns the average current of a subsystem, which is its
+// uAh per hour. AvgCurrent averages over ~5.6 s, longer than a NORMAL cycle,
+// so single windows are smoothed but the totals converge. Windows in which
+// the battery is charged are not attributed.
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+#include "timebase.h"
+
+typedef enum EnergySubsystemEnum{
+    ENERGY_CPU,         // everything not listed below
+    ENERGY_SENSOR,      // STC31 measurement including its I2C transfers
+    ENERGY_GAUGE,       // MAX17260 register transfers
+    ENERGY_RENDER,      // drawing into LCD_GRAM
+    ENERGY_DISPLAY,     // display frame over SPI
+    ENERGY_SLEEP,       // LPM3 between cycles, static consumers
+    ENERGY_SUBSYSTEMS
+} EnergySubsystem;
+
+typedef struct EnergyTotalsStruct{
+    uint32_t nAh[ENERGY_SUBSYSTEMS];    // attributed charge
+    uint32_t seconds;                   // attributed time
+    uint16_t ticks;                     // ACLK ticks below one second
+} EnergyTotals;
+
+#if ENERGY
+
+extern EnergyTotals Energy;
+
+void energy_switch(uint8_t subsystem);
+void energy_wait(uint8_t subsystem, uint8_t waiting);
+void energy_idle(uint8_t idle);
+void energy_window(int32_t avg_current);
+uint16_t energy_rate(uint8_t subsystem);
+
+#define ENERGY_BEGIN(subsystem)     energy_switch(subsystem)
+#define ENERGY_END()                energy_switch(ENERGY_CPU)
+#define ENERGY_WAIT(subsystem)      energy_wait(subsystem, 1)
+#define ENERGY_DONE(subsystem)      energy_wait(subsystem, 0)
+#define ENERGY_IDLE_BEGIN()         energy_idle(1)
+#define ENERGY_IDLE_END()           energy_idle(0)
+
+#else
+
+#define ENERGY_BEGIN(subsystem)     ((void)0)
+#define ENERGY_END()                ((void)0)
+#define ENERGY_WAIT(subsystem)      ((void)0)
+#define ENERGY_DONE(subsystem)      ((void)0)
+#define ENERGY_IDLE_BEGIN()         ((void)0)
+#define ENERGY_IDLE_END()           ((void)0)
+#define energy_window(avg_current)  ((void)(avg_current))
+
+#endif /* ENERGY */
+
+#endif /* ENERGY_H */
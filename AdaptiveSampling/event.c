@@ -0,0 +1,56 @@
+//******************************************************************************
+
+#include <stdint.h>
+#include "event.h"
+
+RING_STORAGE(EventSlots, EVENT_SLOTS);
+Ring Events = RING_INIT(EventSlots);
+
+static volatile uint8_t EventsOpen = 0;
+volatile uint8_t EventsLost = 0;     // dropped since the last event_take()
+
+
+//******************************************************************************
+// Producer ********************************************************************
+//******************************************************************************
+
+// called from ISRs only
+void event_post(EventId id, uint8_t arg)
+{
+    if (!EventsOpen)
+        return;
+    if (!ring_put(&Events, (uint16_t)id | ((uint16_t)arg << 8)) && EventsLost < 0xFF)
+        EventsLost++;
+}
+
+
+//******************************************************************************
+// Consumer ********************************************************************
+//******************************************************************************
+
+void event_open(void)
+{
+    ring_flush(&Events);
+    EventsLost = 0;
+    EventsOpen = 1;
+}
+
+void event_close(void)
+{
+    EventsOpen = 0;
+}
+
+// 1 if an event is queued or one was lost
+uint8_t event_pending(void)
+{
+    return ring_count(&Events) || EventsLost;
+}
+
+// takes the oldest event, returns 0 if there is none
+uint8_t event_take(uint16_t *entry)
+{
+    if (ring_get(&Events, entry))
+        return 1;
+    EventsLost = 0;     // loss seen, the queue is empty
+    return 0;
+}
@@ -0,0 +1,192 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "fram.h"
+#include "fram_log.h"
+
+
+//******************************************************************************
+// Persistent Storage **********************************************************
+//******************************************************************************
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(Log)
+#endif
+FRAM_PERSISTENT FramLog Log = {{0, FRAM_LOG_DECIMATION, 0}, {{0}}};
+
+#define FRAM_LOG_HEAD()         (Log.block[Log.head.total & (FRAM_LOG_BLOCKS - 1)])
+
+// RAM state kept over LPM3.5, valid only right after fram_log_suspend()
+typedef struct LogResumeStruct{
+    CodecState encoder;
+    uint16_t skip;
+    uint16_t total;         // Log.head.total the encoder state belongs to
+    uint8_t valid;
+} LogResume;
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(Resume)
+#endif
+FRAM_PERSISTENT LogResume Resume = {{{0}}, 0, 0, 0};
+
+
+//******************************************************************************
+// RAM State *******************************************************************
+//******************************************************************************
+
+static CodecState LogEncoder;
+static LogRecord LogStage[FRAM_LOG_BATCH];
+static uint8_t LogStaged = 0;
+static uint16_t LogSkip = 0;
+static uint32_t LogClock = 0;
+
+
+//******************************************************************************
+// Block Handling **************************************************************
+//******************************************************************************
+
+// closes the open block, write window must be open. The new block is emptied
+// before the commit, at worst the oldest block is seen empty after a reset.
+static void fram_log_next_block(void)
+{
+    uint16_t total = Log.head.total + 1;
+
+    Log.block[total & (FRAM_LOG_BLOCKS - 1)][0] = 0;
+    if (total == 2 * FRAM_LOG_BLOCKS)
+        total = FRAM_LOG_BLOCKS;
+    Log.head.total = total;  // single word store commits the block
+
+    codec_block_begin(&LogEncoder);
+}
+
+// encodes one sample into the open block, write window must be open
+static void fram_log_append(const LogRecord *record)
+{
+    if (!codec_encode(&LogEncoder, record, FRAM_LOG_HEAD())) {
+        fram_log_next_block();
+        codec_encode(&LogEncoder, record, FRAM_LOG_HEAD());
+    }
+}
+
+
+//******************************************************************************
+// Log Functions ***************************************************************
+//******************************************************************************
+
+// continues the log clock where the last flush left it. The encoder state of
+// a partly filled block is gone after a reset, so that block is closed.
+void fram_log_init(void)
+{
+    LogClock = Log.head.time;
+    LogStaged = 0;
+    LogSkip = 0;
+
+    codec_block_begin(&LogEncoder);
+    if (FRAM_LOG_HEAD()[0]) {
+        FRAM_WRITE_ENABLE();
+        fram_log_next_block();
+        FRAM_WRITE_DISABLE();
+    }
+}
+
+// flushes the staged samples and saves the encoder state for a deep sleep,
+// the log clock is in Log.head.time after the flush
+void fram_log_suspend(void)
+{
+    fram_log_flush();
+
+    FRAM_WRITE_ENABLE();
+    Log.head.time = LogClock;
+    Resume.encoder = LogEncoder;
+    Resume.skip = LogSkip;
+    Resume.total = Log.head.total;
+    Resume.valid = 1;
+    FRAM_WRITE_DISABLE();
+}
+
+// continues after a deep sleep, falls back to fram_log_init() if there is no
+// matching suspend
+void fram_log_resume(void)
+{
+    if (!Resume.valid || Resume.total != Log.head.total) {
+        fram_log_init();
+        return;
+    }
+    LogClock = Log.head.time;
+    LogStaged = 0;
+    LogSkip = Resume.skip;
+    LogEncoder = Resume.encoder;
+
+    FRAM_WRITE_ENABLE();
+    Resume.valid = 0;       // a reset before the next suspend closes the block
+    FRAM_WRITE_DISABLE();
+}
+
+// advances the log clock, called once per main loop period
+void fram_log_tick(uint16_t seconds)
+{
+    LogClock += seconds;
+}
+
+// stamps and stages a sample, every decimation-th call is kept. Returns 1
+// when the batch was written to FRAM.
+uint8_t fram_log_sample(LogRecord *record)
+{
+    if (++LogSkip < Log.head.decimation)
+        return 0;
+    LogSkip = 0;
+
+    record->timestamp = LogClock;
+    LogStage[LogStaged++] = *record;
+
+    if (LogStaged < FRAM_LOG_BATCH)
+        return 0;
+    fram_log_flush();
+    return 1;
+}
+
+// encodes all staged samples to FRAM in one write window
+void fram_log_flush(void)
+{
+    uint8_t i;
+
+    if (LogStaged == 0)
+        return;
+
+    FRAM_WRITE_ENABLE();
+    for (i = 0; i < LogStaged; i++)
+        fram_log_append(&LogStage[i]);
+    Log.head.time = LogClock;
+    FRAM_WRITE_DISABLE();
+
+    LogStaged = 0;
+}
+
+void fram_log_set_decimation(uint16_t decimation)
+{
+    if (decimation == 0)
+        decimation = 1;
+    FRAM_WRITE_ENABLE();
+    Log.head.decimation = decimation;
+    FRAM_WRITE_DISABLE();
+}
+
+// closed blocks plus the open one. Once the ring is full the oldest closed
+// block is the one the next block change empties and reopens.
+uint16_t fram_log_blocks(void)
+{
+    uint16_t total = Log.head.total;
+
+    if (total > FRAM_LOG_BLOCKS - 1)
+        total = FRAM_LOG_BLOCKS - 1;
+    return total + 1;
+}
+
+// index 0 is the oldest block, fram_log_blocks() - 1 the open one
+const uint8_t *fram_log_block(uint16_t index)
+{
+    uint16_t total = Log.head.total;
+
+    return Log.block[(total - (fram_log_blocks() - 1) + index) & (FRAM_LOG_BLOCKS - 1)];
+}
@@ -0,0 +1,60 @@
+//******************************************************************************
+// FRAM Time-Series Log ********************************************************
+//******************************************************************************
+//
+// Ring buffer of compressed sample blocks (see sample_codec.h) in FRAM
+// (#pragma PERSISTENT). Samples are staged in RAM and encoded FRAM_LOG_BATCH
+// at a time straight into the open block inside one program FRAM write window
+// (SYSCFG0.PFWP). Every sample is committed by the block's count byte and a
+// full block by a single 16-bit store of LogHeader.total, so a power failure
+// at any point leaves a consistent log. Append is O(1) and nothing is scanned
+// at boot.
+//
+// The whole log is one contiguous object, a memory dump of Log can be decoded
+// on the host with tools/log_decode.
+//
+// Before LPM3.5 (deep_sleep.h) fram_log_suspend() flushes the staged samples
+// and keeps the encoder state in FRAM; fram_log_resume() picks the open block
+// up again where init would have to close it.
+//
+// FRAM budget (0xC400-0xFF7F, 15232 bytes, shared by code, constants and
+// persistents): the firmware takes about 13.4 KB, 14.8 KB with
+// POWER_PROFILE, TRACE and ENERGY all enabled, the log's 16 blocks of
+// CODEC_BLOCK_SIZE included. That leaves about 1.8 KB, or 0.45 KB in the
+// debug build, so 16 is the largest power of two that fits every build.
+// The host tools are built against the same value.
+
+#ifndef FRAM_LOG_H
+#define FRAM_LOG_H
+
+#include <stdint.h>
+#include "sample_codec.h"
+
+#define FRAM_LOG_BLOCKS         16  // blocks in FRAM, must be a power of two
+#define FRAM_LOG_BATCH          4   // samples staged in RAM per FRAM write
+#define FRAM_LOG_DECIMATION     1   // default: log every n-th sample
+
+typedef struct LogHeaderStruct{
+    uint16_t total;         // closed blocks, wraps from 2*BLOCKS to BLOCKS
+    uint16_t decimation;    // log every n-th sample
+    uint32_t time;          // log clock at the last flush
+} LogHeader;
+
+typedef struct FramLogStruct{
+    LogHeader head;
+    uint8_t block[FRAM_LOG_BLOCKS][CODEC_BLOCK_SIZE];
+} FramLog;
+
+extern FramLog Log;
+
+void fram_log_init(void);
+void fram_log_suspend(void);
+void fram_log_resume(void);
+void fram_log_tick(uint16_t seconds);
+uint8_t fram_log_sample(LogRecord *record);
+void fram_log_flush(void);
+void fram_log_set_decimation(uint16_t decimation);
+uint16_t fram_log_blocks(void);
+const uint8_t *fram_log_block(uint16_t index);
+
+#endif /* FRAM_LOG_H */
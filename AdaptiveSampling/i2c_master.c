@@ -0,0 +1,133 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "i2c_master.h"
+#include "power_profile.h"
+#include "event.h"
+
+I2C_Context I2CBus = {IDLE_MODE};
+
+
+//******************************************************************************
+// Transfer Completion *********************************************************
+//******************************************************************************
+
+// LPM0 until the ISR has finished the transfer, call with interrupts disabled
+// right after the start condition
+void i2c_wait(void)
+{
+    while (!I2C_DONE()) {          // other ISRs may wake the CPU, too
+        POWER_PROFILE_SLEEP(POWER_LPM0, LPM0_bits + GIE); // Enter LPM0 w/ interrupts
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+}
+
+
+//******************************************************************************
+// Interrupts ******************************************************************
+//******************************************************************************
+
+// I2C interrupt service routine for STC31 and gauge
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = USCI_B0_VECTOR
+__interrupt void USCI_B0_ISR(void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(USCI_B0_VECTOR))) USCI_B0_ISR (void)
+#else
+#error Compiler not supported!
+#endif
+{
+  //Must read from UCB0RXBUF
+  uint8_t rx_val = 0;
+  switch(__even_in_range(UCB0IV, USCI_I2C_UCBIT9IFG))
+  {
+    case USCI_NONE:          break;         // Vector 0: No interrupts
+    case USCI_I2C_UCALIFG:   break;         // Vector 2: ALIFG
+    case USCI_I2C_UCNACKIFG:                // Vector 4: NACKIFG
+        // no slave at the address or a byte refused: end the transfer
+        UCB0CTLW0 |= UCTXSTP;
+        UCB0IE &= ~(UCTXIE | UCRXIE);
+        I2CBus.mode = NACK_MODE;
+        event_post(EVENT_I2C_DONE, (uint8_t)UCB0I2CSA);
+        __bic_SR_register_on_exit(CPUOFF);      // Exit LPM0
+        break;
+    case USCI_I2C_UCSTTIFG:  break;         // Vector 6: STTIFG
+    case USCI_I2C_UCSTPIFG:  break;         // Vector 8: STPIFG
+    case USCI_I2C_UCRXIFG3:  break;         // Vector 10: RXIFG3
+    case USCI_I2C_UCTXIFG3:  break;         // Vector 12: TXIFG3
+    case USCI_I2C_UCRXIFG2:  break;         // Vector 14: RXIFG2
+    case USCI_I2C_UCTXIFG2:  break;         // Vector 16: TXIFG2
+    case USCI_I2C_UCRXIFG1:  break;         // Vector 18: RXIFG1
+    case USCI_I2C_UCTXIFG1:  break;         // Vector 20: TXIFG1
+    case USCI_I2C_UCRXIFG0:                 // Vector 22: RXIFG0
+        rx_val = UCB0RXBUF;
+        if (I2CBus.rx_count)
+        {
+          I2CBus.rx_buffer[I2CBus.rx_index++] = rx_val;
+          I2CBus.rx_count--;
+        }
+
+        if (I2CBus.rx_count == 1)
+        {
+          UCB0CTLW0 |= UCTXSTP;
+        }
+        else if (I2CBus.rx_count == 0)
+        {
+          UCB0IE &= ~UCRXIE;
+          I2CBus.mode = IDLE_MODE;
+          event_post(EVENT_I2C_DONE, (uint8_t)UCB0I2CSA);
+          __bic_SR_register_on_exit(CPUOFF);      // Exit LPM0
+        }
+        break;
+    case USCI_I2C_UCTXIFG0:                 // Vector 24: TXIFG0
+        switch (I2CBus.mode)
+        {
+          case TX_REG_ADDRESS_MODE:
+              UCB0TXBUF = I2CBus.reg_addr;
+              if (I2CBus.rx_count)
+                  I2CBus.mode = SWITCH_TO_RX_MODE;   // Need to start receiving now
+              else
+                  I2CBus.mode = TX_DATA_MODE;        // Continue to transmission with the data at tx_data
+              break;
+
+          case SWITCH_TO_RX_MODE:
+              UCB0IE |= UCRXIE;              // Enable RX interrupt
+              UCB0IE &= ~UCTXIE;             // Disable TX interrupt
+              UCB0CTLW0 &= ~UCTR;            // Switch to receiver
+              I2CBus.mode = RX_DATA_MODE;    // State state is to receive data
+              UCB0CTLW0 |= UCTXSTT;          // Send repeated start
+              if (I2CBus.rx_count == 1)
+              {
+                  //Must send stop since this is the N-1 byte
+                  while((UCB0CTLW0 & UCTXSTT));
+                  UCB0CTLW0 |= UCTXSTP;      // Send stop condition
+              }
+              break;
+
+          case TX_DATA_MODE:
+              if (I2CBus.tx_count)
+              {
+                  UCB0TXBUF = I2CBus.tx_data[I2CBus.tx_index++];
+                  I2CBus.tx_count--;
+              }
+              else
+              {
+                  //Done with transmission
+                  UCB0CTLW0 |= UCTXSTP;     // Send stop condition
+                  I2CBus.mode = IDLE_MODE;
+                  UCB0IE &= ~UCTXIE;                       // disable TX interrupt
+                  event_post(EVENT_I2C_DONE, (uint8_t)UCB0I2CSA);
+                  __bic_SR_register_on_exit(CPUOFF);      // Exit LPM0
+              }
+              break;
+
+          default:
+              __no_operation();
+              break;
+        }
+        break;
+    default: break;
+  }
+}
@@ -0,0 +1,86 @@
+//******************************************************************************
+// Single-Producer/Single-Consumer Ring ****************************************
+//******************************************************************************
+//
+// A queue of 16-bit entries from one producer, usually an ISR, to one
+// consumer, usually the main loop, without disabling interrupts. head is only
+// written by the producer and tail only by the consumer. Both run freely and
+// are masked on use, so the number of slots must be a power of two (at most
+// 32768). The producer writes the slot first and then publishes it with its
+// head store, the consumer reads the slot before it hands it back with its
+// tail store. On the MSP430 volatile keeps that order: a 16-bit word is one
+// store and the single core sees its own stores in order. A host build (the
+// tools) uses C11 atomics instead, with release stores and acquire loads of
+// head and tail, so it also holds between threads on different cores.
+//
+//     RING_STORAGE(EventSlots, 16);
+//     Ring Events = RING_INIT(EventSlots);
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+#if defined(__MSP430__)
+#define RING_INDEX                  volatile uint16_t
+#define RING_LOAD(index)            (index)
+#define RING_ACQUIRE(index)         (index)
+#define RING_RELEASE(index, value)  ((index) = (value))
+#else
+#include <stdatomic.h>
+#define RING_INDEX                  _Atomic uint16_t
+#define RING_LOAD(index)            atomic_load_explicit(&(index), memory_order_relaxed)
+#define RING_ACQUIRE(index)         atomic_load_explicit(&(index), memory_order_acquire)
+#define RING_RELEASE(index, value)  atomic_store_explicit(&(index), (value), memory_order_release)
+#endif
+
+typedef struct RingStruct{
+    RING_INDEX head;            // producer: next slot to write
+    RING_INDEX tail;            // consumer: next slot to read
+    uint16_t mask;              // slots - 1
+    volatile uint16_t *slot;
+} Ring;
+
+#define RING_SIZE_OK(slots)     ((slots) && !((slots) & ((slots) - 1)) && (slots) <= 32768U)
+
+// declares the slot array, fails to compile if slots is no power of two
+#define RING_STORAGE(name, slots)                                           \
+    typedef char name##_size_check[RING_SIZE_OK(slots) ? 1 : -1];           \
+    static volatile uint16_t name[slots]
+
+#define RING_INIT(storage)  \
+    {0, 0, (uint16_t)(sizeof(storage) / sizeof((storage)[0]) - 1), (storage)}
+
+// producer side, returns 0 and drops value if the ring is full
+static inline uint8_t ring_put(Ring *ring, uint16_t value) {
+    uint16_t head = RING_LOAD(ring->head);
+
+    if ((uint16_t)(head - RING_ACQUIRE(ring->tail)) > ring->mask)
+        return 0;
+    ring->slot[head & ring->mask] = value;
+    RING_RELEASE(ring->head, head + 1);     // publishes the slot
+    return 1;
+}
+
+// consumer side, returns 0 if the ring is empty
+static inline uint8_t ring_get(Ring *ring, uint16_t *value) {
+    uint16_t tail = RING_LOAD(ring->tail);
+
+    if (tail == RING_ACQUIRE(ring->head))
+        return 0;
+    *value = ring->slot[tail & ring->mask];
+    RING_RELEASE(ring->tail, tail + 1);     // hands the slot back
+    return 1;
+}
+
+// consumer side, entries waiting
+static inline uint16_t ring_count(const Ring *ring) {
+    return (uint16_t)(RING_ACQUIRE(ring->head) - RING_LOAD(ring->tail));
+}
+
+// consumer side, drops everything queued so far
+static inline void ring_flush(Ring *ring) {
+    RING_RELEASE(ring->tail, RING_ACQUIRE(ring->head));
+}
+
+#endif /* RING_H */
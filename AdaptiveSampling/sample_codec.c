@@ -0,0 +1,156 @@
+//******************************************************************************
+
+#include <stdint.h>
+#include "sample_codec.h"
+
+#define CODEC_FIELDS    7   // timestamp + 6 sample fields
+
+
+//******************************************************************************
+// Varint Helpers **************************************************************
+//******************************************************************************
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 0x01);
+}
+
+static uint8_t put_varint(uint8_t *out, uint32_t value)
+{
+    uint8_t n = 0;
+
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// reads one varint, *pos ends up past CODEC_BLOCK_SIZE if the block is cut off
+static uint32_t get_varint(const uint8_t *block, uint8_t *pos)
+{
+    uint32_t value = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+
+    do {
+        if (*pos >= CODEC_BLOCK_SIZE || shift > 28) {
+            *pos = CODEC_BLOCK_SIZE + 1;
+            return 0;
+        }
+        byte = block[(*pos)++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+
+//******************************************************************************
+// Encoder *********************************************************************
+//******************************************************************************
+
+// starts a new block, the next sample is a reset point
+void codec_block_begin(CodecState *enc)
+{
+    enc->prev.timestamp = 0;
+    enc->prev.co2 = 0;
+    enc->prev.temperature = 0;
+    enc->prev.vcell = 0;
+    enc->prev.current = 0;
+    enc->prev.soc = 0;
+    enc->prev.mode = 0;
+    enc->prev_delta = 0;
+    enc->length = 1;
+    enc->count = 0;
+}
+
+// appends a sample to block, returns 0 (and leaves block and state untouched)
+// if it does not fit. The sample bytes are written before the count byte, so
+// an interrupted append is invisible to the decoder.
+uint8_t codec_encode(CodecState *enc, const LogRecord *record, uint8_t *block)
+{
+    uint8_t sample[CODEC_MAX_SAMPLE];
+    int32_t diff[CODEC_FIELDS];
+    uint32_t delta = record->timestamp - enc->prev.timestamp;
+    uint8_t mask = 0;
+    uint8_t n = 1;
+    uint8_t i;
+
+    diff[0] = (int32_t)(delta - (uint32_t)enc->prev_delta);
+    diff[1] = (int32_t)record->co2 - enc->prev.co2;
+    diff[2] = (int32_t)record->temperature - enc->prev.temperature;
+    diff[3] = (int32_t)record->vcell - enc->prev.vcell;
+    diff[4] = (int32_t)record->current - enc->prev.current;
+    diff[5] = (int32_t)record->soc - enc->prev.soc;
+    diff[6] = (int32_t)record->mode - enc->prev.mode;
+
+    for (i = 0; i < CODEC_FIELDS; i++) {
+        if (diff[i]) {
+            mask |= 1 << i;
+            n += put_varint(&sample[n], zigzag(diff[i]));
+        }
+    }
+    sample[0] = mask;
+
+    if (enc->length + n > CODEC_BLOCK_SIZE)
+        return 0;
+
+    for (i = 0; i < n; i++)
+        block[enc->length + i] = sample[i];
+    enc->length += n;
+    block[0] = ++enc->count;
+
+    // the reset point carries the absolute time, the delta chain starts after it
+    enc->prev_delta = (enc->count == 1) ? 0 : (int32_t)delta;
+    enc->prev = *record;
+    return 1;
+}
+
+
+//******************************************************************************
+// Decoder *********************************************************************
+//******************************************************************************
+
+void codec_decode_begin(CodecState *dec)
+{
+    codec_block_begin(dec);
+}
+
+// returns 1 and the next sample of block, 0 at the end of the block
+uint8_t codec_decode(CodecState *dec, const uint8_t *block, LogRecord *record)
+{
+    int32_t diff[CODEC_FIELDS];
+    uint32_t delta;
+    uint8_t mask;
+    uint8_t i;
+
+    if (dec->count >= block[0] || dec->length >= CODEC_BLOCK_SIZE)
+        return 0;
+
+    mask = block[dec->length++];
+    for (i = 0; i < CODEC_FIELDS; i++)
+        diff[i] = (mask & (1 << i)) ? unzigzag(get_varint(block, &dec->length)) : 0;
+    if (dec->length > CODEC_BLOCK_SIZE)
+        return 0;
+
+    delta = (uint32_t)dec->prev_delta + (uint32_t)diff[0];
+    record->timestamp = dec->prev.timestamp + delta;
+    record->co2 = (uint16_t)(dec->prev.co2 + diff[1]);
+    record->temperature = (int16_t)(dec->prev.temperature + diff[2]);
+    record->vcell = (uint16_t)(dec->prev.vcell + diff[3]);
+    record->current = (int16_t)(dec->prev.current + diff[4]);
+    record->soc = (uint8_t)(dec->prev.soc + diff[5]);
+    record->mode = (uint8_t)(dec->prev.mode + diff[6]);
+
+    dec->count++;
+    dec->prev_delta = (dec->count == 1) ? 0 : (int32_t)delta;
+    dec->prev = *record;
+    return 1;
+}
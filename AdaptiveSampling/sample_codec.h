@@ -0,0 +1,54 @@
+//******************************************************************************
+// Sample Codec ****************************************************************
+//******************************************************************************
+//
+// Streaming compression of LogRecords into fixed-size blocks. Each block is a
+// reset point: the encoder state starts from zero, so every block decodes on
+// its own. Block layout:
+//
+//   [0]      number of samples in the block (written last, commits a sample)
+//   [1..]    samples
+//
+// Sample layout:
+//
+//   mask     bit 0: timestamp delta-of-delta != 0, bits 1..6: field delta != 0
+//   varints  zig-zag LEB128 for every bit set in mask, in bit order
+//
+// Fields in bit order: co2, temperature, vcell, current, soc, mode. Repeated
+// gauge values (the MAX17260 hibernates for 5.6 s) and a steady sample period
+// cost nothing but the mask byte.
+//
+// The codec only depends on <stdint.h>, it is also built into the host tools.
+
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <stdint.h>
+
+#define CODEC_BLOCK_SIZE        64
+#define CODEC_MAX_SAMPLE        24  // mask + 5 byte timestamp + 6 * 3 byte fields
+
+typedef struct LogRecordStruct{
+    uint32_t timestamp;     // s since the log was created
+    uint16_t co2;           // ppm
+    int16_t temperature;    // 0.01 degC (STC31)
+    uint16_t vcell;         // mV
+    int16_t current;        // uA, AvgCurrent clipped to +-32767
+    uint8_t soc;            // %
+    uint8_t mode;           // main loop mode at the time of the sample
+} LogRecord;
+
+typedef struct CodecStateStruct{
+    LogRecord prev;         // last sample in the block
+    int32_t prev_delta;     // last timestamp delta
+    uint8_t length;         // bytes used in the block
+    uint8_t count;          // samples in the block
+} CodecState;
+
+void codec_block_begin(CodecState *enc);
+uint8_t codec_encode(CodecState *enc, const LogRecord *record, uint8_t *block);
+
+void codec_decode_begin(CodecState *dec);
+uint8_t codec_decode(CodecState *dec, const uint8_t *block, LogRecord *record);
+
+#endif /* SAMPLE_CODEC_H */
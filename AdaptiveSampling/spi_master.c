@@ -0,0 +1,100 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "spi_master.h"
+#include "sensirion_i2c_hal.h"
+#include "clock.h"
+#include "power_profile.h"
+#include "trace.h"
+#include "event.h"
+
+SPI_Context SPIBus = {SPI_IDLE};
+
+
+//******************************************************************************
+// SPI Functions ***************************************************************
+//******************************************************************************
+
+// starts sending count bytes and returns, the ISR sends them at UCTXIFG
+void spi_start(const uint8_t *data, uint8_t count)
+{
+    CopyArray(data, SPIBus.tx_buffer, count);
+    SPIBus.tx_count = count;
+    SPIBus.tx_index = 0;
+    SPIBus.mode = SPI_TX;
+
+    TRACE_SPI_EVENT(TRACE_SPI_START, count);
+    UCA1IE = UCTXIE;                // UCTXIFG is set while the buffer is empty
+}
+
+// LPM0 until the transfer started by spi_start() is out
+void spi_wait(void)
+{
+    __disable_interrupt();
+    while (SPIBus.mode != SPI_IDLE){ // other ISRs may wake the CPU, too
+        POWER_PROFILE_SLEEP(POWER_LPM0, CPUOFF + GIE); // Enter LPM0 w/interrupts enabled
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+}
+
+SPI_Mode SPI_Master_WriteReg(const uint8_t *reg_data, uint8_t count)
+{
+    spi_start(reg_data, count);
+    spi_wait();
+    return SPIBus.mode;
+}
+
+
+// called by the ISR once the last byte has left the shift register
+static void spi_done(void)
+{
+    UCA1IE = 0;
+    SPIBus.mode = SPI_IDLE;
+    TRACE_SPI_EVENT(TRACE_SPI_END, 0);
+    event_post(EVENT_SPI_DONE, SPIBus.tx_index);
+}
+
+
+//******************************************************************************
+// Interrupts ******************************************************************
+//******************************************************************************
+
+// SPI ISR
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector=USCI_A1_VECTOR
+__interrupt void USCI_A1_ISR(void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(USCI_A1_VECTOR))) USCI_A1_ISR (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    switch(__even_in_range(UCA1IV, USCI_SPI_UCTXIFG))
+    {
+        case USCI_NONE: break;
+        case USCI_SPI_UCRXIFG:      // the last byte is out
+            spi_done();
+            __bic_SR_register_on_exit(CPUOFF);  // Exit LPM0
+            break;
+        case USCI_SPI_UCTXIFG:
+            if (SPIBus.tx_count){
+                // the buffer takes the next byte while one shifts out
+                UCA1TXBUF = SPIBus.tx_buffer[SPIBus.tx_index++];
+                SPIBus.tx_count--;
+                break;
+            }
+            // the last byte has moved to the shift register, the ones
+            // before it are out: its UCRXIFG ends the transfer
+            UCA1IFG &= ~UCRXIFG;
+            if (UCA1STATW & UCBUSY){
+                UCA1IE = UCRXIE;
+                break;
+            }
+            spi_done();             // already out as well
+            __bic_SR_register_on_exit(CPUOFF);  // Exit LPM0
+            break;
+        default: break;
+    }
+}
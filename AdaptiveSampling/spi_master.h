@@ -0,0 +1,37 @@
+//******************************************************************************
+// SPI Master Context **********************************************************
+//******************************************************************************
+//
+// State of the eUSCI_A1 transfers to the Sharp memory LCD, apart from the I2C
+// context (i2c_master.h) so both buses can be busy at once. spi_start()
+// returns at once, the USCI_A1 ISR feeds a byte at every UCTXIFG and, once
+// the last one has left the shift register, sets mode back to SPI_IDLE,
+// which is the completion flag. The LCD is write-only,
+// bytes received while sending are dropped. Chip select is up to the caller.
+
+#ifndef SPI_MASTER_H
+#define SPI_MASTER_H
+
+#include <stdint.h>
+
+#define SPI_BUFFER_SIZE     18  // one display line: address, 16 bytes, trailer
+
+typedef enum SPI_ModeEnum{
+    SPI_IDLE,
+    SPI_TX
+} SPI_Mode;
+
+typedef struct SPI_ContextStruct{
+    volatile SPI_Mode mode;     // SPI_IDLE once the transfer is out
+    uint8_t tx_count;           // bytes still to send
+    uint8_t tx_index;
+    uint8_t tx_buffer[SPI_BUFFER_SIZE];
+} SPI_Context;
+
+extern SPI_Context SPIBus;
+
+void spi_start(const uint8_t *data, uint8_t count);
+void spi_wait(void);
+SPI_Mode SPI_Master_WriteReg(const uint8_t *reg_data, uint8_t count);
+
+#endif /* SPI_MASTER_H */
@@ -0,0 +1,91 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "task.h"
+#include "clock.h"
+#include "i2c_master.h"
+#include "spi_master.h"
+#include "power_profile.h"
+#include "event.h"
+#include "trace.h"
+#include "energy.h"
+
+// what the waiting tasks of the current pass need
+static uint8_t NeedI2C = 0;
+static uint8_t NeedSPI = 0;
+static uint8_t NeedTime = 0;
+static uint16_t Deadline;
+
+
+//******************************************************************************
+// Wait Conditions *************************************************************
+//******************************************************************************
+
+uint8_t task_i2c_idle(void)
+{
+    if (I2C_DONE())
+        return 1;
+    NeedI2C = 1;
+    return 0;
+}
+
+uint8_t task_spi_idle(void)
+{
+    if (SPIBus.mode == SPI_IDLE)
+        return 1;
+    NeedSPI = 1;
+    return 0;
+}
+
+uint8_t task_reached(uint16_t tick)
+{
+    if (clock_reached(tick))
+        return 1;
+    if (!NeedTime || (int16_t)(tick - Deadline) < 0)
+        Deadline = tick;
+    NeedTime = 1;
+    return 0;
+}
+
+
+//******************************************************************************
+// Idle Loop *******************************************************************
+//******************************************************************************
+
+// sleeps until a waiting task can go on, call after a pass with waiting tasks.
+// Every completion a task waits for is posted to the event queue, so a
+// queued event means the pass has to run again. Only the deadline is checked
+// directly, CCR1 cannot catch a tick that has already passed.
+void task_idle(void)
+{
+    uint16_t event;
+
+    __disable_interrupt();
+    if (event_pending() || (NeedTime && clock_reached(Deadline))) {
+        // completed during the pass, run again
+    } else if (NeedI2C || NeedSPI) {
+        if (NeedTime)
+            clock_wake_at(Deadline);
+        ENERGY_IDLE_BEGIN();
+        POWER_PROFILE_SLEEP(POWER_LPM0, LPM0_bits + GIE); // buses need SMCLK
+        __disable_interrupt();
+        ENERGY_IDLE_END();
+    } else if (NeedTime) {
+        clock_wake_at(Deadline);
+        ENERGY_IDLE_BEGIN();
+        POWER_PROFILE_SLEEP(POWER_LPM3, LPM3_bits + GIE);
+        __disable_interrupt();
+        ENERGY_IDLE_END();
+    }
+    clock_wake_off();
+    NeedI2C = NeedSPI = NeedTime = 0;
+    __enable_interrupt();
+
+    // the tasks look at the state themselves, the queue only tells why the
+    // pass runs again
+    if (event_take(&event))
+        TRACE_EVENT(TRACE_TASK_WAKE, EVENT_ID(event));
+    while (event_take(&event))
+        ;
+}
@@ -0,0 +1,69 @@
+//******************************************************************************
+// Cooperative Tasks ***********************************************************
+//******************************************************************************
+//
+// Stackless tasks in the manner of protothreads, for the work of one wake-up.
+// A task is a function that takes its Task, which holds nothing but the
+// resume point (2 bytes of RAM). Its body sits between TASK_BEGIN() and
+// TASK_END(). TASK_WAIT_UNTIL() returns TASK_WAITING while the condition is
+// false, and the next call resumes at that line. Locals do not survive a
+// wait, so keep state in statics. The macros use a switch, so a wait must
+// not sit inside a switch of the task.
+//
+// The wait conditions tell the idle loop what a task needs:
+//   task_i2c_idle()     the I2C transfer has ended (i2c_master.h)
+//   task_spi_idle()     the SPI transfer has ended (spi_master.h)
+//   task_reached(tick)  TA2 has passed tick (clock.h)
+// The caller runs every task once per pass. If any task is still waiting,
+// task_idle() sleeps. It uses LPM0 while a task waits for a bus and LPM3
+// when only deadlines are left, and TA2 CCR1 wakes it at the earliest one.
+// The ISRs post their completions to the event queue (event.h), which the
+// caller opens around the passes. A completion during the pass is queued and
+// keeps task_idle() awake, so none is lost. A task that waits on a flag set by another task must
+// come after that task in the pass.
+
+#ifndef TASK_H
+#define TASK_H
+
+#include <stdint.h>
+
+#define TASK_DONE_LINE      0xFFFF
+
+typedef struct TaskStruct{
+    uint16_t line;          // resume point, 0 = from the top
+} Task;
+
+typedef enum TaskStateEnum{
+    TASK_WAITING,
+    TASK_DONE
+} TaskState;
+
+#define TASK_INIT(t)            ((t)->line = 0)
+
+#define TASK_BEGIN(t)           switch ((t)->line) { case 0:
+
+#define TASK_WAIT_UNTIL(t, c)                               \
+    do {                                                    \
+        (t)->line = __LINE__; case __LINE__:                \
+        if (!(c))                                           \
+            return TASK_WAITING;                            \
+    } while (0)
+
+#define TASK_EXIT(t)                                        \
+    do {                                                    \
+        (t)->line = TASK_DONE_LINE;                         \
+        return TASK_DONE;                                   \
+    } while (0)
+
+#define TASK_END(t)                                         \
+        (t)->line = TASK_DONE_LINE;                         \
+        case TASK_DONE_LINE: ;                              \
+    }                                                       \
+    return TASK_DONE
+
+uint8_t task_i2c_idle(void);
+uint8_t task_spi_idle(void);
+uint8_t task_reached(uint16_t tick);
+void task_idle(void);
+
+#endif /* TASK_H */
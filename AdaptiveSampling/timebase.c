@@ -0,0 +1,75 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "timebase.h"
+#include "trace.h"
+
+#if TIMEBASE
+
+static volatile uint16_t TimebaseHigh = 0;
+
+
+//******************************************************************************
+// Timebase Functions **********************************************************
+//******************************************************************************
+
+void timebase_init(void)
+{
+    TimebaseHigh = 0;
+    TA3CTL = TASSEL__ACLK | MC__CONTINUOUS | TACLR | TAIE;
+}
+
+// TA3R is clocked asynchronously to MCLK, it is read until two reads agree
+uint16_t timebase_ticks(void)
+{
+    uint16_t ticks;
+
+    do {
+        ticks = TA3R;
+    } while (ticks != TA3R);
+    return ticks;
+}
+
+// 32-bit ACLK time, a pending overflow is accounted for if TA3R has wrapped
+uint32_t timebase_now(void)
+{
+    uint16_t state = __get_interrupt_state();
+    uint16_t high, low;
+
+    __disable_interrupt();
+    low = timebase_ticks();
+    high = TimebaseHigh;
+    if ((TA3CTL & TAIFG) && low < 0x8000)
+        high++;
+    __set_interrupt_state(state);
+
+    return ((uint32_t)high << 16) | low;
+}
+
+
+//******************************************************************************
+// Interrupts ******************************************************************
+//******************************************************************************
+
+// Timer3 overflow, extends TA3R to 32 bit
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = TIMER3_A1_VECTOR
+__interrupt void Timer3_Overflow (void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(TIMER3_A1_VECTOR))) Timer3_Overflow (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    switch(__even_in_range(TA3IV, TA3IV_TAIFG))
+    {
+        case TA3IV_TAIFG:
+            TimebaseHigh++;
+            TRACE_EVENT(TRACE_WRAP, 0);
+            break;
+        default: break;
+    }
+}
+
+#endif /* TIMEBASE */
@@ -0,0 +1,43 @@
+//******************************************************************************
+// Debug Timebase **************************************************************
+//******************************************************************************
+//
+// TA3 runs continuously from ACLK (32768 Hz, 30.5 us per tick) and its
+// overflow interrupt extends it to 32 bit. It is shared by the power state
+// accounting (power_profile.h), the event trace (trace.h) and the energy
+// attribution (energy.h) and only exists while one of them is enabled. The
+// overflow wakes the CPU every 2 s.
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+
+#ifndef POWER_PROFILE
+#define POWER_PROFILE 0
+#endif
+
+#ifndef TRACE
+#define TRACE 0
+#endif
+
+#ifndef ENERGY
+#define ENERGY 0
+#endif
+
+#define TIMEBASE        (POWER_PROFILE || TRACE || ENERGY)
+#define TIMEBASE_HZ     32768UL
+
+#if TIMEBASE
+
+void timebase_init(void);
+uint16_t timebase_ticks(void);
+uint32_t timebase_now(void);
+
+#else
+
+#define timebase_init()     ((void)0)
+
+#endif /* TIMEBASE */
+
+#endif /* TIMEBASE_H */
@@ -0,0 +1,79 @@
+//******************************************************************************
+// Event Trace *****************************************************************
+//******************************************************************************
+//
+// Optional instrumentation, enabled with TRACE=1 in the compiler defines.
+// TRACE_EVENT() stores a 4 byte event with the low 16 bit of the timebase
+// (see timebase.h) in a RAM ring of the last TRACE_EVENTS events, which
+// takes a few dozen cycles. The timebase overflow records a TRACE_WRAP event,
+// so the full time can be rebuilt from the ring alone.
+//
+// Halt in the debugger, save the memory of the Trace object and convert it
+// with tools/trace_decode into Chrome trace JSON (chrome://tracing or
+// ui.perfetto.dev).
+//
+// TRACE=2 also records every SPI frame with TRACE_SPI_EVENT(). A display
+// update alone is 130 frames, so raise TRACE_EVENTS or look at one update.
+// With TRACE=0 TRACE_EVENT() expands to nothing. This header only depends on
+// <stdint.h>, it is also built into the host tools.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "timebase.h"
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS    128     // events in the ring, must be a power of two
+#endif
+
+typedef enum TraceIdEnum{
+    TRACE_WRAP = 1,     // timebase overflow
+    TRACE_CYCLE,        // main loop iteration, arg = mode
+    TRACE_LPM_ENTER,    // arg = PowerState
+    TRACE_LPM_EXIT,
+    TRACE_I2C_START,    // arg = slave address
+    TRACE_I2C_STOP,     // arg = slave address
+    TRACE_REG_READ,     // register transaction, arg = register address
+    TRACE_REG_WRITE,    // arg = register address
+    TRACE_STC_CMD,      // Sensirion command, arg = low byte of the command
+    TRACE_SPI_START,    // arg = byte count
+    TRACE_SPI_END,
+    TRACE_DISPLAY_START,
+    TRACE_DISPLAY_END,
+    TRACE_TASK_WAKE     // task_idle() went on, arg = first queued EventId
+} TraceId;
+
+typedef struct TraceEventStruct{
+    uint16_t time;      // ACLK ticks, low 16 bit
+    uint8_t id;
+    uint8_t arg;
+} TraceEvent;
+
+typedef struct TraceBufferStruct{
+    uint16_t head;      // next slot to write
+    uint16_t full;      // the ring has wrapped, head is the oldest event
+    TraceEvent event[TRACE_EVENTS];
+} TraceBuffer;
+
+#if TRACE
+
+extern TraceBuffer Trace;
+
+void trace_event(uint8_t id, uint8_t arg);
+
+#define TRACE_EVENT(id, arg)    trace_event(id, arg)
+
+#else
+
+#define TRACE_EVENT(id, arg)    ((void)0)
+
+#endif /* TRACE */
+
+#if TRACE >= 2
+#define TRACE_SPI_EVENT(id, arg)    trace_event(id, arg)
+#else
+#define TRACE_SPI_EVENT(id, arg)    ((void)0)
+#endif
+
+#endif /* TRACE_H */
@@ -0,0 +1,275 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "uart_export.h"
+#include "fram_log.h"
+#include "cobs.h"
+#include "power_profile.h"
+#include "boot.h"
+
+#define EXPORT_PAYLOAD_MAX  (5 + CODEC_BLOCK_SIZE + 2)  // 'B' header + block + CRC
+#define EXPORT_FRAME_MAX    (EXPORT_PAYLOAD_MAX + COBS_MAX_OVERHEAD(EXPORT_PAYLOAD_MAX) + 1)
+#define EXPORT_REQUEST_MAX  16
+
+
+//******************************************************************************
+// Export State ****************************************************************
+//******************************************************************************
+
+typedef enum ExportModeEnum{
+    EXPORT_IDLE,
+    EXPORT_BLOCKS,      // sending 'B' frames
+    EXPORT_END          // 'E' frame pending
+} ExportMode;
+
+static ExportMode ExportState = EXPORT_IDLE;
+static uint16_t ExportNext;
+static uint16_t ExportLast;
+
+static uint8_t Payload[EXPORT_PAYLOAD_MAX];
+static uint8_t TxFrame[EXPORT_FRAME_MAX];
+static uint8_t TxLength = 0;
+static uint8_t TxIndex = 0;
+
+static uint8_t RxFrame[EXPORT_REQUEST_MAX];
+static uint8_t RxLength = 0;
+static volatile uint8_t RxSeen = 0;     // host activity since uart_export_busy()
+
+
+//******************************************************************************
+// Frame Handling **************************************************************
+//******************************************************************************
+
+static void put16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+// appends the CRC, encodes Payload into TxFrame and starts sending
+static void send_payload(uint8_t length)
+{
+    put16(&Payload[length], crc16_ccitt(Payload, length));
+    TxLength = cobs_encode(Payload, length + 2, TxFrame);
+    TxFrame[TxLength++] = 0;
+    TxIndex = 0;
+    UCA0IFG |= UCTXIFG;     // the ISR sends the first byte
+    UCA0IE |= UCTXIE;
+}
+
+static void send_info(void)
+{
+    Payload[0] = EXPORT_RSP_INFO;
+    put16(&Payload[1], Log.head.total);
+    put16(&Payload[3], fram_log_blocks());
+    Payload[5] = CODEC_BLOCK_SIZE;
+    put16(&Payload[6], Log.head.decimation);
+    put16(&Payload[8], (uint16_t)Log.head.time);
+    put16(&Payload[10], (uint16_t)(Log.head.time >> 16));
+    put16(&Payload[12], Boot.cold_ms);
+    put16(&Payload[14], Boot.wake_ms);
+    send_payload(16);
+}
+
+#if POWER_PROFILE
+// live power state counters, ticks[mode][state] then cycles[mode]
+static void send_power(void)
+{
+    uint8_t *p = &Payload[1];
+    uint8_t i, j;
+
+    Payload[0] = EXPORT_RSP_POWER;
+    for (i = 0; i < POWER_MODES; i++)
+        for (j = 0; j < POWER_STATES; j++, p += 4) {
+            put16(p, (uint16_t)PowerStats.ticks[i][j]);
+            put16(p + 2, (uint16_t)(PowerStats.ticks[i][j] >> 16));
+        }
+    for (i = 0; i < POWER_MODES; i++, p += 4) {
+        put16(p, (uint16_t)PowerStats.cycles[i]);
+        put16(p + 2, (uint16_t)(PowerStats.cycles[i] >> 16));
+    }
+    send_payload(p - Payload);
+}
+#endif
+
+// prepares the next frame of a running read, returns 0 when there is none
+static uint8_t send_next(void)
+{
+    const uint8_t *block;
+    uint8_t i;
+
+    switch (ExportState) {
+        case EXPORT_BLOCKS:
+            block = fram_log_block(ExportNext);
+            Payload[0] = EXPORT_RSP_BLOCK;
+            put16(&Payload[1], ExportNext);
+            put16(&Payload[3], Log.head.total);
+            for (i = 0; i < CODEC_BLOCK_SIZE; i++)
+                Payload[5 + i] = block[i];
+            if (++ExportNext >= ExportLast)
+                ExportState = EXPORT_END;
+            send_payload(5 + CODEC_BLOCK_SIZE);
+            return 1;
+
+        case EXPORT_END:
+            Payload[0] = EXPORT_RSP_END;
+            put16(&Payload[1], ExportNext);
+            ExportState = EXPORT_IDLE;
+            send_payload(3);
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// handles a complete request frame from the host
+static void handle_request(void)
+{
+    uint8_t request[EXPORT_REQUEST_MAX];
+    uint16_t length = cobs_decode(RxFrame, RxLength, request);
+    uint16_t blocks;
+
+    if (length < 3 || crc16_ccitt(request, length - 2) !=
+            (request[length - 2] | ((uint16_t)request[length - 1] << 8)))
+        return;
+    if (TxIndex < TxLength || ExportState != EXPORT_IDLE)
+        return;     // still busy, the host retries
+
+    switch (request[0]) {
+        case EXPORT_CMD_INFO:
+            send_info();
+            break;
+
+        case EXPORT_CMD_READ:
+            if (length < 7)
+                return;
+            blocks = fram_log_blocks();
+            ExportNext = request[1] | ((uint16_t)request[2] << 8);
+            ExportLast = ExportNext + (request[3] | ((uint16_t)request[4] << 8));
+            if (ExportLast > blocks || ExportLast < ExportNext)
+                ExportLast = blocks;
+            ExportState = (ExportNext < ExportLast) ? EXPORT_BLOCKS : EXPORT_END;
+            send_next();
+            break;
+
+#if POWER_PROFILE
+        case EXPORT_CMD_POWER:
+            send_power();
+            break;
+#endif
+
+        default:
+            break;
+    }
+}
+
+
+//******************************************************************************
+// Initialization **************************************************************
+//******************************************************************************
+
+void uart_export_init(void)
+{
+    // woken from LPM3.5 by the host
+    if (P1IFG & BIT5)
+        RxSeen = 1;
+    P1IE &= ~BIT5;
+    P1IFG &= ~BIT5;
+
+    // UCA0 pins
+    P1SEL0 |= BIT4 | BIT5;
+    P1SEL1 &= ~(BIT4 | BIT5);
+
+    UCA0CTLW0 = UCSWRST;                    // **Put eUSCI module in reset**
+    UCA0CTLW0 |= UCSSEL__SMCLK;
+    UCA0BRW = 1;                            // 16MHz / (16 * 1) = 1Mbaud,
+                                            // clock_set() adapts it later
+    UCA0MCTLW = UCOS16;                     // UCBRFx = 0, UCBRSx = 0
+    UCA0CTLW0 &= ~UCSWRST;                  // **Initialize eUSCI module**
+    UCA0IE |= UCRXIE;
+}
+
+// RXD as a falling-edge wake-up from LPM3.5, called right before deep_sleep()
+void uart_export_park(void)
+{
+    P1SEL0 &= ~BIT5;
+    P1DIR &= ~BIT5;
+    P1IES |= BIT5;
+    P1IFG &= ~BIT5;
+    P1IE |= BIT5;
+}
+
+// 1 while a response is going out or the host has sent anything since the
+// last call
+uint8_t uart_export_busy(void)
+{
+    uint8_t seen = RxSeen;
+
+    RxSeen = 0;
+    return seen || TxIndex < TxLength || ExportState != EXPORT_IDLE;
+}
+
+
+//******************************************************************************
+// Interrupts ******************************************************************
+//******************************************************************************
+
+// UART ISR, receives requests and streams the response frames
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector=USCI_A0_VECTOR
+__interrupt void USCI_A0_ISR(void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(USCI_A0_VECTOR))) USCI_A0_ISR (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    uint8_t rx_val;
+
+    switch(__even_in_range(UCA0IV, USCI_UART_UCTXCPTIFG))
+    {
+        case USCI_NONE: break;
+        case USCI_UART_UCRXIFG:
+            rx_val = UCA0RXBUF;
+            RxSeen = 1;
+            if (rx_val == 0) {
+                if (RxLength && RxLength <= EXPORT_REQUEST_MAX)
+                    handle_request();
+                RxLength = 0;
+            } else if (RxLength < EXPORT_REQUEST_MAX) {
+                RxFrame[RxLength++] = rx_val;
+            } else {
+                RxLength = EXPORT_REQUEST_MAX + 1;  // overlong, drop until delimiter
+            }
+            break;
+        case USCI_UART_UCTXIFG:
+            if (TxIndex >= TxLength && !send_next()) {
+                UCA0IE &= ~UCTXIE;
+                break;
+            }
+            UCA0TXBUF = TxFrame[TxIndex++];
+            break;
+        case USCI_UART_UCSTTIFG: break;
+        case USCI_UART_UCTXCPTIFG: break;
+        default: break;
+    }
+}
+
+
+// Port 1 ISR, host activity on the parked RXD before LPM3.5 was reached
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = PORT1_VECTOR
+__interrupt void Port1 (void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(PORT1_VECTOR))) Port1 (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    P1IE &= ~BIT5;
+    P1IFG &= ~BIT5;
+    RxSeen = 1;
+    __bic_SR_register_on_exit(LPM3_bits);         // Exit LPM
+}
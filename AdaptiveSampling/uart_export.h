@@ -0,0 +1,54 @@
+//******************************************************************************
+// UART Log Export *************************************************************
+//******************************************************************************
+//
+// Interrupt-driven dump of the FRAM log on eUSCI_A0 (P1.4 TXD, P1.5 RXD) at
+// 1 Mbaud from SMCLK (see clock.h). Everything runs in the eUSCI_A0 ISR, the
+// main loop only calls uart_export_init() once; the UART requests SMCLK by
+// itself while it is busy, so a transfer goes on during LPM3 and never holds
+// up the sampling schedule.
+//
+// Every frame is COBS encoded, terminated by 0x00 and carries a CRC-16 (see
+// cobs.h). Little endian payloads:
+//
+//   host -> device
+//     'I'                              request log info
+//     'R' first(2) count(2)            request blocks, index 0 = oldest
+//     'P'                              request power counters (POWER_PROFILE=1)
+//
+//   device -> host
+//     'I' total(2) blocks(2) block_size(1) decimation(2) time(4)
+//         boot_cold_ms(2) boot_wake_ms(2)      see boot.h
+//     'B' index(2) total(2) data(block_size)
+//     'E' next(2)                      end of a read, next index to request
+//     'P' ticks(4 x 3 x 4) cycles(4 x 4)  PowerStats, see power_profile.h
+//
+// A transfer is resumed by requesting again from the first missing index;
+// total tells the host how far the ring has moved in between. Frames with a
+// bad CRC are dropped, the host retries on timeout. The host should send a
+// 0x00 before a request, the first byte after LPM3 may be lost while the
+// DCO starts up.
+//
+// The UART is off in LPM3.5. uart_export_park() turns RXD into a port wake-up
+// before a deep sleep, so the first request wakes the device and is lost;
+// the host's retry is answered. uart_export_busy() tells the main loop to
+// stay out of LPM3.5 while the host is around.
+
+#ifndef UART_EXPORT_H
+#define UART_EXPORT_H
+
+#include <stdint.h>
+
+#define EXPORT_CMD_INFO     'I'
+#define EXPORT_CMD_READ     'R'
+#define EXPORT_CMD_POWER    'P'
+#define EXPORT_RSP_INFO     'I'
+#define EXPORT_RSP_BLOCK    'B'
+#define EXPORT_RSP_END      'E'
+#define EXPORT_RSP_POWER    'P'
+
+void uart_export_init(void);
+void uart_export_park(void);
+uint8_t uart_export_busy(void);
+
+#endif /* UART_EXPORT_H */
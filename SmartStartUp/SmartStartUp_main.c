@@ -2,6 +2,17 @@
 #include "sensirion_common.h"
 #include "sensirion_i2c_hal.h"
 #include "stc3x_i2c.h"
+#include "conversion.h"
+#include "clock.h"
+#include "power_profile.h"
+#include "timebase.h"
+#include "trace.h"
+#include "loads.h"
+#include "app_link.h"
+#include "deep_sleep.h"
+#include "fram.h"
+#include "boot.h"
+#include "i2c_master.h"
 #include <inttypes.h>
 #include <msp430.h>
 #include <stdint.h>
@@ -13,7 +24,7 @@
 //******************************************************************************
 
 #define SLAVE_ADDR_MAX17260  0x36 // MAX17260
-#define MAX_BUFFER_SIZE 20
+#define GAUGE_ALRT_PIN       BIT2 // MAX17260 ALRT on P2.2
 
 /* MasterTypeX are example buffers initialized in the master, they will be
  * sent by the master to the slave.
@@ -43,35 +54,15 @@ uint8_t RepSOC [2] = {0};
 uint8_t RepCAP [2] = {0};
 uint8_t Data [2] = {0};
 uint8_t Test [2] = {0};
+uint8_t Config [2] = {0};
+uint8_t FullCapRep [2] = {0};
+uint8_t SAlrtTh [2] = {0x00, 0xFF}; // {min, max} in %, 0x00/0xFF = off
+uint8_t VAlrtTh [2] = {0x00, 0xFF}; // {min, max} in 20 mV
 
 //******************************************************************************
 // I2C FSM and Functions *******************************************************
 //******************************************************************************
 
-typedef enum I2C_ModeEnum{
-    IDLE_MODE,
-    NACK_MODE,
-    TX_REG_ADDRESS_MODE,
-    RX_REG_ADDRESS_MODE,
-    TX_DATA_MODE,
-    RX_DATA_MODE,
-    SWITCH_TO_RX_MODE,
-    SWITCH_TO_TX_MODE,
-    TIMEOUT_MODE
-} I2C_Mode;
-
-
-/* Used to track the state of the software state machine*/
-I2C_Mode MasterMode = IDLE_MODE;
-
-uint8_t TransmitRegAddr = 0;
-uint8_t ReceiveBuffer[MAX_BUFFER_SIZE] = {0};
-uint8_t RXByteCtr = 0;
-uint8_t ReceiveIndex = 0;
-uint8_t TransmitBuffer[MAX_BUFFER_SIZE] = {0};
-uint8_t TXByteCtr = 0;
-uint8_t TransmitIndex = 0;
-
 I2C_Mode I2C_Master_WriteReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t *reg_data, uint8_t count);
 I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count);
 
@@ -79,12 +70,12 @@ I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count);
 I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count)
 {
     /* Initialize state machine */
-    MasterMode = TX_REG_ADDRESS_MODE;
-    TransmitRegAddr = reg_addr;
-    RXByteCtr = count;
-    TXByteCtr = 0;
-    ReceiveIndex = 0;
-    TransmitIndex = 0;
+    I2CBus.mode = TX_REG_ADDRESS_MODE;
+    I2CBus.reg_addr = reg_addr;
+    I2CBus.rx_count = count;
+    I2CBus.tx_count = 0;
+    I2CBus.rx_index = 0;
+    I2CBus.tx_index = 0;
 
     /* Initialize slave address and interrupts */
     UCB0I2CSA = dev_addr;
@@ -92,10 +83,14 @@ I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count)
     UCB0IE &= ~UCRXIE;                       // Disable RX interrupt
     UCB0IE |= UCTXIE;                        // Enable TX interrupt
 
+    TRACE_EVENT(TRACE_REG_READ, reg_addr);
+    TRACE_EVENT(TRACE_I2C_START, dev_addr);
+    __disable_interrupt();
     UCB0CTLW0 |= UCTR + UCTXSTT;             // I2C TX, start condition
-    __bis_SR_register(LPM0_bits + GIE);              // Enter LPM0 w/ interrupts
+    i2c_wait();
+    TRACE_EVENT(TRACE_I2C_STOP, dev_addr);
 
-    return MasterMode;
+    return I2CBus.mode;
 
 }
 
@@ -103,16 +98,15 @@ I2C_Mode I2C_Master_ReadReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t count)
 I2C_Mode I2C_Master_WriteReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t *reg_data, uint8_t count)
 {
     /* Initialize state machine */
-    MasterMode = TX_REG_ADDRESS_MODE;
-    TransmitRegAddr = reg_addr;
+    I2CBus.mode = TX_REG_ADDRESS_MODE;
+    I2CBus.reg_addr = reg_addr;
 
-    //Copy register data to TransmitBuffer
-    CopyArray(reg_data, TransmitBuffer, count);
+    I2CBus.tx_data = reg_data;              // sent in place, the call blocks
 
-    TXByteCtr = count;
-    RXByteCtr = 0;
-    ReceiveIndex = 0;
-    TransmitIndex = 0;
+    I2CBus.tx_count = count;
+    I2CBus.rx_count = 0;
+    I2CBus.rx_index = 0;
+    I2CBus.tx_index = 0;
 
     /* Initialize slave address and interrupts */
     UCB0I2CSA = dev_addr;
@@ -120,10 +114,14 @@ I2C_Mode I2C_Master_WriteReg(uint8_t dev_addr, uint8_t reg_addr, uint8_t *reg_da
     UCB0IE &= ~UCRXIE;                       // Disable RX interrupt
     UCB0IE |= UCTXIE;                        // Enable TX interrupt
 
+    TRACE_EVENT(TRACE_REG_WRITE, reg_addr);
+    TRACE_EVENT(TRACE_I2C_START, dev_addr);
+    __disable_interrupt();
     UCB0CTLW0 |= UCTR + UCTXSTT;             // I2C TX, start condition
-    __bis_SR_register(LPM0_bits + GIE);              // Enter LPM0 w/ interrupts
+    i2c_wait();
+    TRACE_EVENT(TRACE_I2C_STOP, dev_addr);
 
-    return MasterMode;
+    return I2CBus.mode;
 }
 
 
@@ -144,9 +142,15 @@ void initGPIO()
     P2DIR |= 0x01;
     P2OUT = 0x00;
 
-    // turn off power switch for sensor
-    P3DIR |= 0x04;
-    P3OUT = 0x00;
+    // turn off the load switches
+    loads_init();
+    app_link_init();
+
+    // gauge ALRT, open drain and active low: pull-up, falling edge
+    P2DIR &= ~GAUGE_ALRT_PIN;
+    P2REN |= GAUGE_ALRT_PIN;
+    P2OUT |= GAUGE_ALRT_PIN;
+    P2IES |= GAUGE_ALRT_PIN;
 
 
     // Disable the GPIO power-on default high-impedance mode to activate
@@ -178,7 +182,7 @@ void initI2C()
     UCB0CTLW0 |= UCMODE_3 | UCMST | UCSSEL__SMCLK | UCSYNC; // I2C master mode, SMCLK
     UCB0CTLW1 |= UCASTP_2;                    // Automatic stop generated
                                               // after UCB0TBCNT is reached
-    UCB0BRW = 160;                            // fSCL = SMCLK/160 = ~100kHz
+    UCB0BRW = CLOCK_DIVIDER(CLOCK_I2C_HZ);    // fSCL = ~100kHz
     UCB0I2CSA = 0x29;                         // Slave Address
     UCB0CTLW0 &= ~UCSWRST;                    // Clear SW reset, resume operation
     UCB0IE |= UCRXIE | UCNACKIE;
@@ -191,165 +195,443 @@ void initI2C()
 //******************************************************************************
 
 
-void initializeConfig(void){
-    FSTAT[0] = 0;
-    while(FSTAT[0] & 0x01){
-        _delay_cycles(160000); // 10ms Wait Loop. Do not continue until FSTAT.DNR==0
-        I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x3D, 2);
-        CopyArray(ReceiveBuffer, FSTAT, 2);
+#define GAUGE_POLL_TICKS     328 // ~10ms at ACLK = 32768Hz
+
+typedef enum GaugeInitStateEnum{
+    GAUGE_INIT_WAIT_DNR,     // wait for FSTAT.DNR == 0 after power-up
+    GAUGE_INIT_CONFIG,       // write EZ config
+    GAUGE_INIT_WAIT_REFRESH, // wait for ModelCFG.Refresh == 0
+    GAUGE_INIT_DONE
+} GaugeInitState;
+
+typedef enum GaugeEventEnum{
+    GAUGE_EVENT_NONE,        // step done, call gauge_init_step() again
+    GAUGE_EVENT_POLL,        // wait GAUGE_POLL_TICKS before the next step
+    GAUGE_EVENT_READY        // gauge configured, POR flag cleared
+} GaugeEvent;
+
+GaugeInitState GaugeState = GAUGE_INIT_DONE;
+
+
+// (re)starts the gauge bring-up, e.g. after Status.POR has been seen
+void gauge_init_start(void){
+    GaugeState = GAUGE_INIT_WAIT_DNR;
+}
+
+// advances the bring-up by one step, never blocks
+GaugeEvent gauge_init_step(void){
+    switch(GaugeState){
+
+        case GAUGE_INIT_WAIT_DNR:
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x3D, 2);
+            CopyArray(I2CBus.rx_buffer, FSTAT, 2);
+            if (FSTAT[0] & 0x01){ // FSTAT.DNR: data not ready yet
+                return GAUGE_EVENT_POLL;
+            }
+            GaugeState = GAUGE_INIT_CONFIG;
+            return GAUGE_EVENT_NONE;
+
+        case GAUGE_INIT_CONFIG:
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0xBA, 2);
+            CopyArray(I2CBus.rx_buffer, HibCFG, 2); //Store original HibCFG value
+
+            I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0x60 , Write1, 2); // Exit Hibernate Mode step 1
+            I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0xBA , Write2, 2); // Exit Hibernate Mode step 2
+            I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0x60 , Write2, 2); // Exit Hibernate Mode step 3
+
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x18, DesignCap, 2); // Design Capacity
+
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x18, 2);
+            CopyArray(I2CBus.rx_buffer, Test, 2); //test if Design Capacity was written
+
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x1E, IchgTerm, 2); // Termination Current
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x3A, VEmpty, 2); // Empty Voltage
+
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x1D, 2);
+            CopyArray(I2CBus.rx_buffer, Config, 2);
+            Config[0] |= 0x04; // Config.Aen: drive ALRT on threshold alerts
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x1D, Config, 2);
+
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xDB, Write3, 2); // Write ModelCFG, because ChargeVoltage < 4.275V
+            GaugeState = GAUGE_INIT_WAIT_REFRESH;
+            return GAUGE_EVENT_POLL;
+
+        case GAUGE_INIT_WAIT_REFRESH:
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0xDB, 2);
+            CopyArray(I2CBus.rx_buffer, ModelCFG, 2);
+            if (ModelCFG[1] & 0x80){ // ModelCFG.Refresh: model still loading
+                return GAUGE_EVENT_POLL;
+            }
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xBA , HibCFG, 2); // Restore Original HibCFG value
+
+            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2); //Read Status
+            CopyArray(I2CBus.rx_buffer, Status, 2);
+            Status[0] &= 0xFD; // clear Status.POR
+            I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x00, Status, 2);
+            GaugeState = GAUGE_INIT_DONE;
+            return GAUGE_EVENT_READY;
+
+        case GAUGE_INIT_DONE:
+        default:
+            return GAUGE_EVENT_READY;
     }
+}
+
+// sleeps in LPM3 for one poll interval, timer is stopped again afterwards
+void gauge_poll_sleep(void){
+    TA0CCTL0 |= CCIE;
+    TA0CCR0 = GAUGE_POLL_TICKS;
+    TA0CTL = TASSEL__ACLK | MC__UP | TACLR;
+    POWER_PROFILE_SLEEP(POWER_LPM3, LPM3_bits + GIE); // Enter LPM3 w/ interrupts
+    TA0CTL = MC__STOP | TACLR;
+}
+
+// runs the bring-up to completion, sleeping while the gauge is busy
+void initializeConfig(void){
+    GaugeEvent event;
 
+    gauge_init_start();
+    do {
+        event = gauge_init_step();
+        if (event == GAUGE_EVENT_POLL){
+            gauge_poll_sleep();
+        }
+    } while (event != GAUGE_EVENT_READY);
+}
 
-    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0xDB, 2);
-    CopyArray(ReceiveBuffer, HibCFG, 2); //Store original HibCFG value
 
-    I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0x60 , Write1, 2); // Exit Hibernate Mode step 1
-    I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0xBA , Write2, 2); // Exit Hibernate Mode step 2
-    I2C_Master_WriteReg (SLAVE_ADDR_MAX17260, 0x60 , Write2, 2); // Exit Hibernate Mode step 3
+//******************************************************************************
+// Gauge Alerts ****************************************************************
+//******************************************************************************
 
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x18, DesignCap, 2); // Design Capacity
+#define STATUS_ALERTS_HIGH   0xFF // Br, Smx, Tmx, Vmx, Bi, Smn, Tmn, Vmn
+#define STATUS_ALERTS_LOW    0xC4 // dSOCi, Imx, Imn
+#define STATUS_VMN           0x01 // Status.Vmn in the high byte
 
-    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x18, 2);
-    CopyArray(ReceiveBuffer, Test, 2); //test if Design Capacity was written
+#define ALERT_POLL_FAR       256  // s, safety poll while far from a threshold
+#define ALERT_POLL_BOOTING   1    // s, poll close to a shed threshold
+#define RTC_TICKS_PER_S      32   // XT1 / 1024
 
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x1E, IchgTerm, 2); // Termination Current
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x3A, VEmpty, 2); // Empty Voltage
+uint32_t resultCAP;     // uAh
+uint16_t resultSOC;     // %
 
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xDB, Write3, 2); // Write ModelCFG, because ChargeVoltage < 4.275V
 
-    // Poll ModelCFG.Refresh(highest bit), proceed to Step 3 when ModelCFG.Refresh==0.
-    ModelCFG[1] = 0;
-    while (ModelCFG[1] & 0x80){
-        _delay_cycles(160000); // 10ms Wait Loop. Do not continue until ModelCFG.Refresh==0
-        I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0xDB, 2);
-        CopyArray(ReceiveBuffer, ModelCFG, 2);
-    }
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0xBA , HibCFG, 2); // Restore Original HibCFG value
+// Finite state machine, BOOTING while any load rail is on
+typedef enum ModeEnum{
+    CHARGING,
+    BOOTING
+} Mode;
+
+Mode MainMode = CHARGING; // initial state
 
+volatile uint8_t RtcExpired = 0;
 
-    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2); //Read Status
-    CopyArray(ReceiveBuffer, Status, 2);
-    Status[1] &= 0xFF;
-    Status[0] &= 0xFD;
-    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x00, Status, 2);
-    //WriteAndVerifyRegister (0x00, Status AND 0xFFFD); //Write and Verify
 
+//******************************************************************************
+// Charge Planner **************************************************************
+//******************************************************************************
+
+#define PLAN_MIN_S           2    // s, shortest planned sleep
+#define PLAN_MAX_S           1024 // s, longest planned sleep, also without charge
+#define PLAN_MIN_STEP        100  // uAh, RepCAP rise for a rate sample (2 LSB)
+#define TTF_UNKNOWN          0xFFFF
+
+uint8_t TTF [2] = {0};
+uint32_t PlanAnchorCAP = 0;  // RepCAP at the start of the rate window
+uint16_t PlanElapsed = 0;    // s slept since PlanAnchorCAP
+uint32_t PlanRate = 0;       // uAh/h, last charge rate seen in RepCAP
+
+// a * b / c without overflow, saturated to 32 bit, c must not be 0
+static uint32_t plan_scale(uint32_t a, uint32_t b, uint32_t c){
+    uint64_t q = (uint64_t)a * b / c;
+    return (q > 0xFFFFFFFFUL) ? 0xFFFFFFFFUL : (uint32_t)q;
 }
 
-// concatenates two uint8 to one uint16, needed for convert
-uint16_t concatenate(uint8_t d1, uint8_t d2) {
-    uint16_t wd = ((uint16_t)d1 << 8) | d2;
-    return wd;
+// Predicts the time until RepCAP reaches target and returns 3/4 of it as the
+// next sleep. The rate comes from RepCAP over a window long
+// enough for its 50 uAh steps and from TimeToFull (0x20), the faster of the
+// two wins. Without any charge the device sleeps PLAN_MAX_S.
+uint16_t charge_plan(uint16_t target){
+    uint32_t full, remaining, rate, ttf, ttf_t, t = PLAN_MAX_S;
+
+    if (PlanElapsed == 0 || resultCAP < PlanAnchorCAP){
+        PlanAnchorCAP = resultCAP; // (re)start the rate window
+        PlanElapsed = 0;
+    }
+    else if (resultCAP - PlanAnchorCAP >= PLAN_MIN_STEP){
+        PlanRate = plan_scale(resultCAP - PlanAnchorCAP, 3600, PlanElapsed);
+        PlanAnchorCAP = resultCAP;
+        PlanElapsed = 0;
+    }
+    else if (PlanElapsed >= PLAN_MAX_S){
+        rate = PLAN_MIN_STEP * 3600UL / PlanElapsed; // no step yet, at most this
+        if (rate < PlanRate) PlanRate = rate;
+    }
+
+    remaining = (resultCAP < target) ? target - resultCAP : 0;
+    if (PlanRate){
+        t = plan_scale(remaining, 3600, PlanRate);
+    }
+
+    // TimeToFull, 5.625 s per LSB
+    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x20, 2);
+    CopyArray(I2CBus.rx_buffer, TTF, 2);
+    ttf = concatenate(TTF[1], TTF[0]);
+    full = convertCAP(concatenate(FullCapRep[1], FullCapRep[0]));
+    if (ttf != TTF_UNKNOWN && full > resultCAP){
+        ttf = ttf * 45 / 8;     // s to full
+        ttf_t = plan_scale(remaining, ttf, full - resultCAP); // s to target
+        if (ttf_t < t) t = ttf_t;
+    }
+
+    t -= t / 4; // margin
+    if (t < PLAN_MIN_S) t = PLAN_MIN_S;
+    if (t > PLAN_MAX_S) t = PLAN_MAX_S;
+    return (uint16_t)t;
 }
 
-// converts 16 bits to integer value which then can be printed
-uint16_t convertCAP(uint16_t data) {
-    uint16_t res;
-    res = 50*data;
-    return res;
+
+// adds the seconds slept to the rate window
+void plan_advance(uint16_t seconds){
+    PlanElapsed = (seconds < 0xFFFF - PlanElapsed) ? PlanElapsed + seconds : 0xFFFF;
 }
 
-// converts 16 bits to integer value which then can be printed
-uint16_t convertSOC(uint16_t data) {
-    uint16_t res;
-    res = data>>8;
-    return res;
+
+//******************************************************************************
+// Deep Sleep Context **********************************************************
+//******************************************************************************
+
+// planner state kept in FRAM over LPM3.5. Deep sleeps only happen in CHARGING,
+// everything else is read from the gauge again every cycle.
+typedef struct ContextStruct{
+    uint32_t anchor_cap;
+    uint32_t rate;
+    uint16_t elapsed;
+} Context;
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(DeepContext)
+#endif
+FRAM_PERSISTENT Context DeepContext = {0, 0, 0};
+
+void context_save(void){
+    FRAM_WRITE_ENABLE();
+    DeepContext.anchor_cap = PlanAnchorCAP;
+    DeepContext.rate = PlanRate;
+    DeepContext.elapsed = PlanElapsed;
+    FRAM_WRITE_DISABLE();
+    loads_suspend();
 }
 
+void context_restore(void){
+    PlanAnchorCAP = DeepContext.anchor_cap;
+    PlanRate = DeepContext.rate;
+    PlanElapsed = DeepContext.elapsed;
+    loads_resume();
+}
 
 
 //******************************************************************************
-// Main ************************************************************************
+// Alert Functions *************************************************************
 //******************************************************************************
 
-uint16_t resultCAP;
-uint16_t resultSOC;
-const uint16_t thresholdCAP = 1000;
-const uint16_t thresholdCAP_hysteresis = 900;
+// Programs SAlrtTh/VAlrtTh for the next load rail thresholds and returns the
+// sleep time in seconds. SoC alerts have 1 % resolution, so the capacity
+// thresholds are turned into the SoC step before them; once the SoC is in that
+// step the alert is switched off and polling takes over, planned on the way up.
+uint16_t gauge_set_alerts(void){
+    uint32_t full;
+    uint16_t poll = ALERT_POLL_FAR, up, down;
+    uint8_t level;
+
+    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x10, 2);
+    CopyArray(I2CBus.rx_buffer, FullCapRep, 2);
+    full = convertCAP(concatenate(FullCapRep[1], FullCapRep[0]));
+    if (full == 0) full = 1;
+
+    up = loads_next_on();
+    down = loads_next_off();
+
+    SAlrtTh[1] = 0xFF;
+    if (up != LOAD_NO_THRESHOLD){
+        level = up * 100UL / full; // rounded down
+        SAlrtTh[1] = (resultSOC >= level) ? 0xFF : level;
+        poll = charge_plan(up);
+    }
+    SAlrtTh[0] = 0x00;
+    VAlrtTh[0] = 0x00;
+    if (down){
+        level = down * 100UL / full + 1; // rounded up
+        SAlrtTh[0] = (resultSOC <= level) ? 0x00 : level;
+        VAlrtTh[0] = VEmpty[1]; // VMIN = VEmpty, the load pulls the cell down
+        if (resultSOC <= level) poll = ALERT_POLL_BOOTING;
+    }
+    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x03, SAlrtTh, 2);
+    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x01, VAlrtTh, 2);
+    return poll;
+}
 
+// VCell in mV for the load soft-start, loads.c
+uint16_t loads_vcell(void){
+    uint8_t VCell [2];
 
-// Finite state machine
-typedef enum ModeEnum{
-    CHARGING,
-    BOOTING
-} Mode;
+    I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x09, 2);
+    CopyArray(I2CBus.rx_buffer, VCell, 2);
+    return convertV(concatenate(VCell[1], VCell[0]));
+}
 
-Mode MainMode = CHARGING; // initial state
+// clears the alert flags read into Status, which releases ALRT
+void gauge_clear_alerts(void){
+    if (!(Status[1] & STATUS_ALERTS_HIGH) && !(Status[0] & STATUS_ALERTS_LOW)){
+        return;
+    }
+    Status[1] &= (uint8_t)~STATUS_ALERTS_HIGH;
+    Status[0] &= (uint8_t)~STATUS_ALERTS_LOW;
+    I2C_Master_WriteReg(SLAVE_ADDR_MAX17260, 0x00, Status, 2);
+}
 
-int main(void){
-    WDTCTL = WDTPW | WDTHOLD;   // Stop watchdog timer
-    initClockTo16MHz();
-    initGPIO();
-    initI2C();
-    initializeConfig();
+// sleeps in LPM3 until the gauge pulls ALRT low, the application reports or
+// the RTC poll expires, returns the seconds slept. With every rail off long
+// sleeps go to LPM3.5 instead and end in a reset, see main().
+uint16_t alert_sleep(uint16_t seconds){
+    uint16_t ticks;
+
+    if (DEEP_SLEEP && !loads_active() && seconds >= DEEP_SLEEP_MIN_S){
+        context_save();
+        __disable_interrupt();
+        P2IFG &= ~GAUGE_ALRT_PIN;
+        P2IE |= GAUGE_ALRT_PIN; // wakes from LPM3.5 as well
+        if (P2IN & GAUGE_ALRT_PIN){
+            deep_sleep(seconds);
+        }
+        __enable_interrupt();
+        P2IE &= ~GAUGE_ALRT_PIN;
+        return 0; // ALRT came first
+    }
+
+    RtcExpired = 0;
+    RTCMOD = seconds * RTC_TICKS_PER_S - 1;
+    RTCCTL = RTCSS__XT1CLK | RTCSR | RTCPS__1024 | RTCIE;
+
+    __disable_interrupt();
+    P2IFG &= ~GAUGE_ALRT_PIN;
+    P2IE |= GAUGE_ALRT_PIN;
+    if ((P2IN & GAUGE_ALRT_PIN) && !app_link_pending()){ // nothing to do yet
+        POWER_PROFILE_SLEEP(POWER_LPM3, LPM3_bits + GIE); // Enter LPM3 w/ interrupts
+    }
+    __enable_interrupt();
+
+    P2IE &= ~GAUGE_ALRT_PIN;
+    ticks = RTCCNT;
+    RTCCTL = 0;
+    return RtcExpired ? seconds : ticks / RTC_TICKS_PER_S;
+}
+
+//******************************************************************************
+// Boot Sequence ***************************************************************
+//******************************************************************************
 
-    // crystal setup
+#define GAUGE_SETTLE_MS      10 // after the configuration, before the first reading
+
+// requests XT1 for ACLK. The clock system keeps ACLK on REFO until the
+// crystal has started, meanwhile the gauge is configured.
+void xt1_start(void){
     CSCTL4 = SELMS__DCOCLKDIV | SELA__XT1CLK;          // MCLK=SMCLK=DCO; ACLK=XT1
     P2SEL0 |= BIT0 + BIT1;                             // P2.0: XOUT; P2.1: XI1
+}
+
+// waits until XT1 runs, usually it already does
+void xt1_wait(void){
     do
     {
         CSCTL7 &= ~(XT1OFFG | DCOFFG);      // Clear XT1 and DCO fault flag
         SFRIFG1 &= ~OFIFG;
     }while (SFRIFG1 & OFIFG);               // Test oscillator fault flag
+}
+
+//******************************************************************************
+// Main ************************************************************************
+//******************************************************************************
+
+int main(void){
+    uint16_t sleep_s, slept = 0, wait, wake_s, gauge_ready = 0;
+    uint8_t changed;
+
+    WDTCTL = WDTPW | WDTHOLD;   // Stop watchdog timer
+    deep_sleep_woke();          // reads the reset reason first
+    clock_timer_start();        // boot clock and sleep timer
+    initClockTo16MHz();
+    initGPIO();
+    if (deep_sleep_woke()){
+        slept = deep_sleep_elapsed(); // before anything enables interrupts
+    }
+    xt1_start();                // starts up during the gauge configuration
+    initI2C();
+    if (!deep_sleep_woke()){
+        initializeConfig();
+        gauge_ready = clock_ticks() + CLOCK_MS_TICKS(GAUGE_SETTLE_MS);
+    }
+    xt1_wait();
+    timebase_init();
 
-    _delay_cycles(160000);  // 10ms delay
+    if (deep_sleep_woke()){
+        // back from a CHARGING sleep in LPM3.5, the gauge kept its settings
+        context_restore();
+        plan_advance(slept);
+    }
+    else {
+        clock_sleep_until(gauge_ready);
+    }
+    clock_set(CLOCK_BUS_MHZ);   // nothing here is CPU bound
 
 
 
     while(1){
+        power_profile_cycle(MainMode);
+        TRACE_EVENT(TRACE_CYCLE, MainMode);
 
         // Gauge Measurement
         I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x00, 2);
-        CopyArray(ReceiveBuffer, Status, 2);
+        CopyArray(I2CBus.rx_buffer, Status, 2);
         StatusPOR[0] = Status[0] & 0x02;
 
-        if (StatusPOR[0] == 0x00){
-            // Read Capacity in uAh
-            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x05, 2);
-            CopyArray(ReceiveBuffer, RepCAP, 2);
-            resultCAP = convertCAP(concatenate(RepCAP[1], RepCAP[0]));
-
-            // Read State of Charge in %
-            I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x06, 2);
-            CopyArray(ReceiveBuffer, RepSOC, 2);
-            resultSOC = convertSOC(concatenate(RepSOC[1], RepSOC[0]));
+        if (StatusPOR[0]){ // gauge was reset, reload configuration
+            initializeConfig();
         }
 
-        switch(MainMode){
-
-            case CHARGING:
+        // Read Capacity in uAh
+        I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x05, 2);
+        CopyArray(I2CBus.rx_buffer, RepCAP, 2);
+        resultCAP = convertCAP(concatenate(RepCAP[1], RepCAP[0]));
 
-                if (resultCAP > thresholdCAP){ // check if threshold capacity has been reached
-                    MainMode = BOOTING;
-                    // turn on power switch to power application
-                    P3OUT |= 0x04;
-                    break;
-                }
+        // Read State of Charge in %
+        I2C_Master_ReadReg(SLAVE_ADDR_MAX17260, 0x06, 2);
+        CopyArray(I2CBus.rx_buffer, RepSOC, 2);
+        resultSOC = convertSOC(concatenate(RepSOC[1], RepSOC[0]));
 
-                // every ~16 seconds go out of LPM3 and gauge battery
-                TA1CCTL0 |= CCIE;
-                TA1CCR0 = 65535;
-                TA1CTL |= TASSEL__ACLK | MC__UP | ID__8; // set clock to ACLK/8
-                __bis_SR_register(LPM3_bits + GIE);  // Enter LPM3 w/ interrupts
-                break;
+        // switch the load rails, lowest priority shed first
+        changed = loads_update(resultCAP, slept, Status[1] & STATUS_VMN);
 
+        // the application reported its work done, power it down until it asks
+        if (app_link_done(&wake_s) && loads_release(LOAD_APP, wake_s)){
+            changed = 1;
+        }
+        app_link_listen(loads_on(LOAD_APP));
+        boot_done();
 
-            case BOOTING:
-
-                if (resultCAP < thresholdCAP_hysteresis){ // check if threshold capacity has been reached
-                    MainMode = CHARGING;
-                    // turn off power switch
-                    P3OUT &= ~0x04;
-                    break;
-                }
-
-                // every second go out of LPM3 and gauge battery
-                TA0CCTL0 |= CCIE;
-                TA0CCR0 = 32678;
-                TA0CTL |= TASSEL__ACLK | MC__UP;
-                __bis_SR_register(LPM3_bits + GIE); // Enter LPM3 w/ interrupts
-                break;
+        if (changed){
+            PlanElapsed = 0; // the load changed, new rate window
+            power_profile_save();
         }
+        MainMode = loads_active() ? BOOTING : CHARGING;
+
+        // sleep until the gauge reports the next threshold crossing
+        sleep_s = gauge_set_alerts();
+        gauge_clear_alerts();
+        wait = loads_poll(resultCAP);
+        if (wait && wait < sleep_s) sleep_s = wait;
+        slept = alert_sleep(sleep_s);
+        plan_advance(slept);
     }
 }
 
@@ -357,128 +639,52 @@ int main(void){
 // Interrupts ******************************************************************
 //******************************************************************************
 
-// I2C interrupt service routine for STC31 and gauge
+// Timer0 interrupt service routine
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
-#pragma vector = USCI_B0_VECTOR
-__interrupt void USCI_B0_ISR(void)
+#pragma vector = TIMER0_A0_VECTOR
+__interrupt void Timer0 (void)
 #elif defined(__GNUC__)
-void __attribute__ ((interrupt(USCI_B0_VECTOR))) USCI_B0_ISR (void)
+void __attribute__ ((interrupt(TIMER0_A0_VECTOR))) Timer0 (void)
 #else
 #error Compiler not supported!
 #endif
 {
-  //Must read from UCB0RXBUF
-  uint8_t rx_val = 0;
-  switch(__even_in_range(UCB0IV, USCI_I2C_UCBIT9IFG))
-  {
-    case USCI_NONE:          break;         // Vector 0: No interrupts
-    case USCI_I2C_UCALIFG:   break;         // Vector 2: ALIFG
-    case USCI_I2C_UCNACKIFG:                // Vector 4: NACKIFG
-      break;
-    case USCI_I2C_UCSTTIFG:  break;         // Vector 6: STTIFG
-    case USCI_I2C_UCSTPIFG:  break;         // Vector 8: STPIFG
-    case USCI_I2C_UCRXIFG3:  break;         // Vector 10: RXIFG3
-    case USCI_I2C_UCTXIFG3:  break;         // Vector 12: TXIFG3
-    case USCI_I2C_UCRXIFG2:  break;         // Vector 14: RXIFG2
-    case USCI_I2C_UCTXIFG2:  break;         // Vector 16: TXIFG2
-    case USCI_I2C_UCRXIFG1:  break;         // Vector 18: RXIFG1
-    case USCI_I2C_UCTXIFG1:  break;         // Vector 20: TXIFG1
-    case USCI_I2C_UCRXIFG0:                 // Vector 22: RXIFG0
-        rx_val = UCB0RXBUF;
-        if (RXByteCtr)
-        {
-          ReceiveBuffer[ReceiveIndex++] = rx_val;
-          RXByteCtr--;
-        }
-
-        if (RXByteCtr == 1)
-        {
-          UCB0CTLW0 |= UCTXSTP;
-        }
-        else if (RXByteCtr == 0)
-        {
-          UCB0IE &= ~UCRXIE;
-          MasterMode = IDLE_MODE;
-          __bic_SR_register_on_exit(CPUOFF);      // Exit LPM0
-        }
-        break;
-    case USCI_I2C_UCTXIFG0:                 // Vector 24: TXIFG0
-        switch (MasterMode)
-        {
-          case TX_REG_ADDRESS_MODE:
-              UCB0TXBUF = TransmitRegAddr;
-              if (RXByteCtr)
-                  MasterMode = SWITCH_TO_RX_MODE;   // Need to start receiving now
-              else
-                  MasterMode = TX_DATA_MODE;        // Continue to transmision with the data in Transmit Buffer
-              break;
-
-          case SWITCH_TO_RX_MODE:
-              UCB0IE |= UCRXIE;              // Enable RX interrupt
-              UCB0IE &= ~UCTXIE;             // Disable TX interrupt
-              UCB0CTLW0 &= ~UCTR;            // Switch to receiver
-              MasterMode = RX_DATA_MODE;    // State state is to receive data
-              UCB0CTLW0 |= UCTXSTT;          // Send repeated start
-              if (RXByteCtr == 1)
-              {
-                  //Must send stop since this is the N-1 byte
-                  while((UCB0CTLW0 & UCTXSTT));
-                  UCB0CTLW0 |= UCTXSTP;      // Send stop condition
-              }
-              break;
-
-          case TX_DATA_MODE:
-              if (TXByteCtr)
-              {
-                  UCB0TXBUF = TransmitBuffer[TransmitIndex++];
-                  TXByteCtr--;
-              }
-              else
-              {
-                  //Done with transmission
-                  UCB0CTLW0 |= UCTXSTP;     // Send stop condition
-                  MasterMode = IDLE_MODE;
-                  UCB0IE &= ~UCTXIE;                       // disable TX interrupt
-                  __bic_SR_register_on_exit(CPUOFF);      // Exit LPM0
-              }
-              break;
-
-          default:
-              __no_operation();
-              break;
-        }
-        break;
-    default: break;
-  }
+    //TA0CCR0 += 32678;                             // Add Offset to TACCR0
+    __bic_SR_register_on_exit(LPM3_bits);         // Exit LPM
 }
 
 
-// Timer0 interrupt service routine
+// Port 2 interrupt service routine, MAX17260 ALRT
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
-#pragma vector = TIMER0_A0_VECTOR
-__interrupt void Timer0 (void)
+#pragma vector = PORT2_VECTOR
+__interrupt void Port2 (void)
 #elif defined(__GNUC__)
-void __attribute__ ((interrupt(TIMER0_A0_VECTOR))) Timer0 (void)
+void __attribute__ ((interrupt(PORT2_VECTOR))) Port2 (void)
 #else
 #error Compiler not supported!
 #endif
 {
-    //TA0CCR0 += 32678;                             // Add Offset to TACCR0
+    P2IFG &= ~GAUGE_ALRT_PIN;
     __bic_SR_register_on_exit(LPM3_bits);         // Exit LPM
 }
 
 
-// Timer1 interrupt service routine
+// RTC interrupt service routine, safety poll
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
-#pragma vector = TIMER1_A0_VECTOR
-__interrupt void Timer1 (void)
+#pragma vector = RTC_VECTOR
+__interrupt void RTC_ISR (void)
 #elif defined(__GNUC__)
-void __attribute__ ((interrupt(TIMER1_A0_VECTOR))) Timer1 (void)
+void __attribute__ ((interrupt(RTC_VECTOR))) RTC_ISR (void)
 #else
 #error Compiler not supported!
 #endif
 {
-    //P2OUT ^= BIT0;
-    //TA1CCR0 += 32678;                             // Add Offset to TACCR0
-    __bic_SR_register_on_exit(LPM3_bits);         // Exit LPM
+    switch(__even_in_range(RTCIV, RTCIV_RTCIF))
+    {
+        case RTCIV_RTCIF:
+            RtcExpired = 1;
+            __bic_SR_register_on_exit(LPM3_bits); // Exit LPM
+            break;
+        default: break;
+    }
 }
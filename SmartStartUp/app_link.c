@@ -0,0 +1,150 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "app_link.h"
+
+
+//******************************************************************************
+// Link State ******************************************************************
+//******************************************************************************
+
+static volatile uint8_t AppDone = 0;
+static volatile uint16_t AppWake = 0;
+static uint8_t AppListen = 0;
+
+static uint8_t RxFrame[3];
+static uint8_t RxLength = 0;
+
+
+//******************************************************************************
+// Link Functions **************************************************************
+//******************************************************************************
+
+// called before the port lock is released, the link starts deaf
+void app_link_init(void)
+{
+    // done line, driven low by the application: falling edge
+    P1DIR &= ~APP_DONE_PIN;
+    P1REN |= APP_DONE_PIN | BIT5;
+    P1OUT &= ~(APP_DONE_PIN | BIT5);        // pull-downs until app_link_listen()
+    P1IES |= APP_DONE_PIN;
+
+    // UCA0 pins
+    P1SEL0 |= BIT4 | BIT5;
+    P1SEL1 &= ~(BIT4 | BIT5);
+
+    UCA0CTLW0 = UCSWRST;                    // **Put eUSCI module in reset**
+    UCA0CTLW0 |= UCSSEL__ACLK;              // runs in LPM3, clock_set() keeps out
+    UCA0BRW = 3;                            // 32768Hz / 9600 = 3.41
+    UCA0MCTLW = 0x9200;                     // UCBRSx = 0x92, UCOS16 = 0
+    UCA0CTLW0 &= ~UCSWRST;                  // **Initialize eUSCI module**
+    AppListen = 0;
+}
+
+// follows the application power, a report from before is dropped
+void app_link_listen(uint8_t on)
+{
+    if (on == AppListen)
+        return;
+    AppListen = on;
+
+    __disable_interrupt();
+    if (on) {
+        P1OUT |= APP_DONE_PIN | BIT5;       // pull-ups, both lines idle high
+        P1IFG &= ~APP_DONE_PIN;
+        P1IE |= APP_DONE_PIN;
+        RxLength = 0;
+        (void)UCA0RXBUF;                    // clears UCRXIFG
+        UCA0IE |= UCRXIE;
+    } else {
+        P1IE &= ~APP_DONE_PIN;
+        UCA0IE &= ~UCRXIE;
+        P1OUT &= ~(APP_DONE_PIN | BIT5);
+    }
+    AppDone = 0;
+    __enable_interrupt();
+}
+
+// a report is waiting, checked with interrupts disabled before sleeping
+uint8_t app_link_pending(void)
+{
+    return AppDone;
+}
+
+// returns 1 once per report and the requested wake time in seconds
+uint8_t app_link_done(uint16_t *wake_s)
+{
+    uint16_t wake;
+
+    __disable_interrupt();
+    if (!AppDone) {
+        __enable_interrupt();
+        return 0;
+    }
+    wake = AppWake;
+    AppDone = 0;
+    __enable_interrupt();
+
+    *wake_s = wake ? wake : APP_WAKE_DEFAULT_S;
+    return 1;
+}
+
+
+//******************************************************************************
+// Interrupts ******************************************************************
+//******************************************************************************
+
+// UART ISR, collects 'W' frames from the application
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector=USCI_A0_VECTOR
+__interrupt void USCI_A0_ISR(void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(USCI_A0_VECTOR))) USCI_A0_ISR (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    uint8_t rx_val;
+
+    switch(__even_in_range(UCA0IV, USCI_UART_UCTXCPTIFG))
+    {
+        case USCI_NONE: break;
+        case USCI_UART_UCRXIFG:
+            rx_val = UCA0RXBUF;
+            if (RxLength == 0 && rx_val != APP_CMD_WAKE)
+                break;      // resynchronise on the command byte
+            if (RxLength < sizeof(RxFrame)) {
+                RxFrame[RxLength++] = rx_val;
+                break;
+            }
+            RxLength = 0;
+            if ((uint8_t)(RxFrame[0] ^ RxFrame[1] ^ RxFrame[2]) != rx_val)
+                break;
+            AppWake = RxFrame[1] | ((uint16_t)RxFrame[2] << 8);
+            AppDone = 1;
+            __bic_SR_register_on_exit(LPM3_bits); // Exit LPM
+            break;
+        case USCI_UART_UCTXIFG: break;
+        case USCI_UART_UCSTTIFG: break;
+        case USCI_UART_UCTXCPTIFG: break;
+        default: break;
+    }
+}
+
+
+// Port 1 interrupt service routine, done line
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = PORT1_VECTOR
+__interrupt void Port1 (void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(PORT1_VECTOR))) Port1 (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    P1IFG &= ~APP_DONE_PIN;
+    AppWake = 0;
+    AppDone = 1;
+    __bic_SR_register_on_exit(LPM3_bits);         // Exit LPM
+}
@@ -0,0 +1,38 @@
+//******************************************************************************
+// Application Handshake *******************************************************
+//******************************************************************************
+//
+// The powered application tells SmartStartUp that its work is done, so the
+// rail can be cut right away instead of idling until the capacity falls. Two
+// ways, the application uses whichever it has pins for:
+//
+//   - APP_DONE_PIN (P1.6) pulled low: work done, power up again after
+//     APP_WAKE_DEFAULT_S
+//   - a frame on eUSCI_A0 (P1.5 RXD) at 9600 baud, 8N1:
+//       'W' wake_s(2) check(1)     work done, power up again in wake_s
+//     little endian, check = 'W' ^ low ^ high, wake_s = 0 for the default
+//
+// The UART runs from ACLK, so both are received in LPM3. Either wakes the
+// CPU; the main loop collects the report with app_link_done() and holds the
+// rail off for that time (loads_release()). It comes back on once the hold
+// has expired and the capacity is above the rail's on_cap again.
+//
+// The link only listens while the application is powered (app_link_listen()).
+// Otherwise both pins are pulled down, the unpowered application would clamp
+// them low and drain the pull-ups, and its power-down edge is not a report.
+
+#ifndef APP_LINK_H
+#define APP_LINK_H
+
+#include <stdint.h>
+
+#define APP_DONE_PIN        BIT6    // P1.6, active low
+#define APP_WAKE_DEFAULT_S  60      // s
+#define APP_CMD_WAKE        'W'
+
+void app_link_init(void);
+void app_link_listen(uint8_t on);
+uint8_t app_link_pending(void);
+uint8_t app_link_done(uint16_t *wake_s);
+
+#endif /* APP_LINK_H */
@@ -0,0 +1,26 @@
+//******************************************************************************
+// Boot Timing *****************************************************************
+//******************************************************************************
+//
+// The time from the top of main() to the first decision of the main loop,
+// measured on the clock module timer (clock_timer_start() starts it). The
+// main loop calls boot_done() right after its decision, the first call keeps
+// the time in FRAM, separately for cold boots and LPM3.5 wake-ups. The C
+// startup code before main() is not included. Values are in ms, read them
+// with the debugger or, in AdaptiveSampling, with the export 'I' request.
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+
+typedef struct BootTimeStruct{
+    uint16_t cold_ms;       // last boot after a reset
+    uint16_t wake_ms;       // last wake-up from LPM3.5
+} BootTime;
+
+extern BootTime Boot;
+
+void boot_done(void);
+
+#endif /* BOOT_H */
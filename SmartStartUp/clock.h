@@ -0,0 +1,81 @@
+//******************************************************************************
+// Clock Scaling ***************************************************************
+//******************************************************************************
+//
+// The DCO stays locked at 16 MHz; clock_set() only changes the MCLK divider
+// (CSCTL5.DIVM), so a change takes effect at once and the FLL never relocks.
+// SMCLK follows MCLK. Up to 8 MHz no FRAM wait state is needed, it is set
+// before going to 16 MHz and cleared after leaving it.
+//
+// Every eUSCI that runs from SMCLK is reprogrammed for the new clock: I2C
+// (UCB0) keeps CLOCK_I2C_HZ, SPI (UCA1) CLOCK_SPI_HZ and the UART (UCA0)
+// CLOCK_UART_BAUD. Below CLOCK_UART_MIN_MHZ the UART cannot sample its bits,
+// so while it runs from SMCLK clock_set() goes no lower; a CLOCK_BUS_MHZ of 1
+// or 2 then runs at 4. Call clock_set() between transfers only, never from an
+// interrupt. The UART is not under the caller's control, so clock_set()
+// leaves the clock as it is while a response is going out; the caller goes on
+// at the old speed, everything is timed from ClockMHz, and a later call
+// switches.
+//
+// Busy-waits use CLOCK_DELAY_US() / clock_delay_ms() so they last the same
+// time at every clock. The firmware runs at CLOCK_BUS_MHZ while it waits on
+// the buses and the sensor and at CLOCK_FAST_MHZ for CPU-bound work.
+//
+// Longer waits sleep instead. clock_timer_start() sets TA2 running from
+// ACLK / 8 (CLOCK_TICK_HZ) at the top of main() and it is never stopped, so
+// clock_ticks() also counts the time since reset. ACLK is REFO until XT1 has
+// started, both run at 32768 Hz. clock_sleep_ms() / clock_sleep_until() wait
+// in LPM3 on TA2 CCR1, other interrupts do not end the sleep early. SMCLK is
+// off meanwhile, so they are for use between bus transfers. Code with its own
+// sleep loop arms the same wake-up with clock_wake_at().
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <msp430.h>
+#include <stdint.h>
+
+#define CLOCK_FAST_MHZ      16
+#ifndef CLOCK_BUS_MHZ
+#define CLOCK_BUS_MHZ       4       // 1, 2, 4 or 8
+#endif
+
+#define CLOCK_I2C_HZ        100000UL
+#define CLOCK_SPI_HZ        200000UL
+#define CLOCK_UART_BAUD     1000000UL
+#define CLOCK_UART_MIN_MHZ  4       // SMCLK for CLOCK_UART_BAUD, 3x at least
+
+#define CLOCK_TICK_HZ       4096UL  // TA2 from ACLK / 8
+#define CLOCK_SLEEP_MAX_MS  4000    // in one clock_sleep_until()
+
+extern volatile uint8_t ClockMHz;
+
+void clock_set(uint8_t mhz);
+void clock_delay_ms(uint16_t ms);
+void clock_timer_start(void);
+uint16_t clock_ticks(void);
+uint8_t clock_reached(uint16_t tick);
+void clock_sleep_until(uint16_t tick);
+void clock_sleep_ms(uint16_t ms);
+void clock_wake_at(uint16_t tick);
+void clock_wake_off(void);
+
+// divider for a bit rate from the current SMCLK
+#define CLOCK_DIVIDER(hz)   ((uint16_t)(ClockMHz * 1000000UL / (hz)))
+
+// TA2 ticks for a time in ms, rounded up
+#define CLOCK_MS_TICKS(ms)  ((uint16_t)(((ms) * CLOCK_TICK_HZ + 999) / 1000))
+
+// us must be a constant, every branch is an exact __delay_cycles()
+#define CLOCK_DELAY_US(us)                                  \
+    do {                                                    \
+        switch (ClockMHz) {                                 \
+            case 16: __delay_cycles(16UL * (us)); break;    \
+            case 8:  __delay_cycles(8UL * (us)); break;     \
+            case 4:  __delay_cycles(4UL * (us)); break;     \
+            case 2:  __delay_cycles(2UL * (us)); break;     \
+            default: __delay_cycles(1UL * (us)); break;     \
+        }                                                   \
+    } while (0)
+
+#endif /* CLOCK_H */
@@ -0,0 +1,74 @@
+//******************************************************************************
+// Fixed-point unit conversions for the STC31 and the MAX17260
+//
+// All scale factors are chosen so that the division is a power of two and
+// compiles to a shift; rounding is to nearest (half up). Intermediate values
+// are widened where the result would not fit into 16 bit. No floating point
+// is used, so the project does not need libmath.a.
+//
+// The MAX17260 LSBs assume the 100 mOhm sense resistor of the board
+// (DesignCap 0x04B0 = 60 mAh, IchgTerm 0x0080 = 2.0 mA).
+//******************************************************************************
+
+#ifndef CONVERSION_H
+#define CONVERSION_H
+
+#include <stdint.h>
+
+// concatenates two uint8 to one uint16, needed for convert
+static inline uint16_t concatenate(uint8_t d1, uint8_t d2) {
+    return ((uint16_t)d1 << 8) | d2;
+}
+
+/**
+ * STC31 gas ticks (binary gas 0x0003, CO2 in air) to ppm:
+ * ppm = 10^6 * (ticks - 2^14) / 2^15 = (ticks - 16384) * 15625 / 2^9
+ * Readings below 0 vol% are clipped to 0.
+ */
+static inline uint32_t convertGas(uint16_t gas_ticks) {
+    if (gas_ticks <= 16384)
+        return 0;
+    return ((uint32_t)(gas_ticks - 16384) * 15625 + 256) >> 9;
+}
+
+/**
+ * STC31 temperature ticks (signed, 200 ticks per degree) to 0.01 degC:
+ * cdegC = ticks / 2
+ */
+static inline int16_t convertTemperature(uint16_t temperature_ticks) {
+    return (int16_t)(((int32_t)(int16_t)temperature_ticks + 1) >> 1); // 0x7FFF + 1
+}
+
+/**
+ * RepCAP (5.0 uVh / Rsense = 50 uAh per LSB) to uAh.
+ * 50 * 0xFFFF does not fit into 16 bit, the result is 32 bit.
+ */
+static inline uint32_t convertCAP(uint16_t data) {
+    uint32_t d = data;
+    return (d << 5) + (d << 4) + (d << 1); // 32 + 16 + 2 = 50
+}
+
+/**
+ * RepSOC (1/256 % per LSB) to %.
+ */
+static inline uint16_t convertSOC(uint16_t data) {
+    return (data >> 8) + ((data >> 7) & 0x01);
+}
+
+/**
+ * VCell (78.125 uV per LSB) to mV: mV = data * 5 / 2^6
+ */
+static inline uint16_t convertV(uint16_t data) {
+    uint32_t d = data;
+    return (uint16_t)(((d << 2) + d + 32) >> 6);
+}
+
+/**
+ * Current/AvgCurrent (signed, 1.5625 uV / Rsense = 15.625 uA per LSB) to uA:
+ * uA = data * 125 / 2^3
+ */
+static inline int32_t convertCurrent(uint16_t data) {
+    return ((int32_t)(int16_t)data * 125 + 4) >> 3;
+}
+
+#endif /* CONVERSION_H */
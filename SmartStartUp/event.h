@@ -0,0 +1,43 @@
+//******************************************************************************
+// ISR Events ******************************************************************
+//******************************************************************************
+//
+// Queue of what the ISRs finished, for the main loop. It is one SPSC ring
+// (ring.h): ISRs do not nest on the MSP430, so all of them together are the
+// single producer. An entry is the event id in the low byte and an argument in
+// the high byte.
+//
+// ISRs post only while the main loop has the queue open, so the blocking
+// waits (i2c_wait(), clock_sleep_until()) do not fill it. event_open() drops
+// what is left from before. If the ring is full, the event is dropped and
+// counted; event_pending() stays true until the consumer has seen the loss,
+// so a full queue costs at most an extra pass, never a lost wake-up.
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+#include "ring.h"
+
+#define EVENT_SLOTS     16
+
+typedef enum EventIdEnum{
+    EVENT_NONE,
+    EVENT_I2C_DONE,     // arg: slave address
+    EVENT_SPI_DONE,     // arg: bytes sent
+    EVENT_CLOCK         // TA2 CCR1 compare, a deadline has passed
+} EventId;
+
+#define EVENT_ID(entry)     ((uint8_t)(entry))
+#define EVENT_ARG(entry)    ((uint8_t)((entry) >> 8))
+
+extern Ring Events;
+extern volatile uint8_t EventsLost;
+
+void event_post(EventId id, uint8_t arg);
+void event_open(void);
+void event_close(void);
+uint8_t event_pending(void);
+uint8_t event_take(uint16_t *entry);
+
+#endif /* EVENT_H */
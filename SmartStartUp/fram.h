@@ -0,0 +1,29 @@
+//******************************************************************************
+// FRAM Helpers ****************************************************************
+//******************************************************************************
+//
+// Variables that survive resets are placed in program FRAM. With the TI
+// compiler each of them also needs a "#pragma PERSISTENT(name)" in front of
+// its definition, FRAM_PERSISTENT covers GCC. Persistent variables must be
+// initialized, they are set when the program is loaded.
+//
+// Program FRAM is write protected (SYSCFG0.PFWP), writes go between
+// FRAM_WRITE_ENABLE() and FRAM_WRITE_DISABLE(). Info FRAM stays protected.
+
+#ifndef FRAM_H
+#define FRAM_H
+
+#include <msp430.h>
+
+#if defined(__TI_COMPILER_VERSION__)
+#define FRAM_PERSISTENT
+#elif defined(__GNUC__)
+#define FRAM_PERSISTENT __attribute__((persistent))
+#else
+#error Compiler not supported!
+#endif
+
+#define FRAM_WRITE_ENABLE()     SYSCFG0 = FRWPPW | DFWP
+#define FRAM_WRITE_DISABLE()    SYSCFG0 = FRWPPW | DFWP | PFWP
+
+#endif /* FRAM_H */
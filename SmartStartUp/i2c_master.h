@@ -0,0 +1,55 @@
+//******************************************************************************
+// I2C Master Context **********************************************************
+//******************************************************************************
+//
+// State of the eUSCI_B0 master transfers to the STC31 and the MAX17260. It
+// belongs to the I2C register functions in main, the Sensirion HAL and the
+// USCI_B0 ISR below and to nothing else, so another bus (the SPI display) can
+// run at the same time. A transfer loads the counters, sets mode and sends
+// the start condition with interrupts disabled, then calls i2c_wait(). The
+// ISR sets mode back to IDLE_MODE when the transfer is done, or to NACK_MODE
+// after a stop if the slave did not acknowledge; I2C_DONE() is the completion
+// flag, wake-ups by other ISRs do not end the wait. Written bytes
+// are not copied, the ISR sends them from the caller's memory, so constant
+// frames go out straight from FRAM.
+
+#ifndef I2C_MASTER_H
+#define I2C_MASTER_H
+
+#include <stdint.h>
+
+#ifndef I2C_BUFFER_SIZE
+#define I2C_BUFFER_SIZE     48      // stc3x_get_sensor_state() reads 45 bytes
+#endif
+
+typedef enum I2C_ModeEnum{
+    IDLE_MODE,
+    NACK_MODE,
+    TX_REG_ADDRESS_MODE,
+    RX_REG_ADDRESS_MODE,
+    TX_DATA_MODE,
+    RX_DATA_MODE,
+    SWITCH_TO_RX_MODE,
+    SWITCH_TO_TX_MODE,
+    TIMEOUT_MODE
+} I2C_Mode;
+
+typedef struct I2C_ContextStruct{
+    volatile I2C_Mode mode;     // IDLE_MODE once the transfer is complete
+    uint8_t reg_addr;           // sent first by TX_REG_ADDRESS_MODE
+    uint8_t rx_count;           // bytes still to receive
+    uint8_t rx_index;
+    uint8_t tx_count;           // bytes still to send
+    uint8_t tx_index;
+    const uint8_t *tx_data;     // sent in place, must not change until IDLE_MODE
+    uint8_t rx_buffer[I2C_BUFFER_SIZE];
+} I2C_Context;
+
+extern I2C_Context I2CBus;
+
+// the transfer has ended, with IDLE_MODE or NACK_MODE
+#define I2C_DONE()  (I2CBus.mode == IDLE_MODE || I2CBus.mode == NACK_MODE)
+
+void i2c_wait(void);
+
+#endif /* I2C_MASTER_H */
@@ -0,0 +1,336 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "fram.h"
+#include "loads.h"
+#include "power_profile.h"
+
+
+//******************************************************************************
+// Rail Table ******************************************************************
+//******************************************************************************
+
+static const LoadRail LoadRails[] = {
+    //  dir     out     pin   prio  on_cap off_cap min_on ramp_ms
+    {&P3DIR, &P3OUT, BIT2, 0,    1000,  900,    0,     500},  // application
+    //{&P3DIR, &P3OUT, BIT1, 1,    2000,  1500,   60,    0},    // e.g. radio
+};
+
+#define LOAD_RAILS      (sizeof(LoadRails) / sizeof(LoadRails[0]))
+
+typedef char LoadRailsFit[(LOAD_RAILS <= LOAD_RAILS_MAX) ? 1 : -1];
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(LoadStarts)
+#endif
+FRAM_PERSISTENT LoadStart LoadStarts[LOAD_RAILS_MAX] = {{0, 0}};
+
+static uint8_t LoadOn[LOAD_RAILS];
+static uint16_t LoadOnTime[LOAD_RAILS];     // s since switched on
+static uint16_t LoadBackoff[LOAD_RAILS];    // s, next back-off after a sag
+static uint16_t LoadHold[LOAD_RAILS];       // s left before the next ramp
+static uint16_t LoadSinceOn = LOAD_STAGGER_S;
+
+// rail timers kept over LPM3.5, all rails are off then
+typedef struct LoadResumeStruct{
+    uint16_t backoff[LOAD_RAILS_MAX];
+    uint16_t hold[LOAD_RAILS_MAX];
+    uint16_t since_on;
+} LoadResume;
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(LoadSaved)
+#endif
+FRAM_PERSISTENT LoadResume LoadSaved = {{0}, {0}, 0};
+
+
+//******************************************************************************
+// Soft-Start ******************************************************************
+//******************************************************************************
+
+static volatile uint8_t *SoftOut;
+static uint8_t SoftPin;
+static volatile uint16_t SoftWait;   // PWM periods left in the current step
+
+static void load_count(uint8_t i, uint8_t completed)
+{
+    FRAM_WRITE_ENABLE();
+    if (completed)
+        LoadStarts[i].completed++;
+    else
+        LoadStarts[i].attempts++;
+    FRAM_WRITE_DISABLE();
+}
+
+// ramps rail i up, returns 1 when it reached full duty and 0 when VCell sagged
+static uint8_t load_soft_start(uint8_t i)
+{
+    uint16_t periods;
+    uint8_t duty;
+
+    load_count(i, 0);
+    periods = (uint32_t)LoadRails[i].ramp_ms * 32768 / 1000 / LOAD_PWM_PERIOD / LOAD_PWM_PERIOD;
+    if (periods == 0)
+        periods = 1;
+
+    SoftOut = LoadRails[i].out;
+    SoftPin = LoadRails[i].pin;
+    TA1CCR0 = LOAD_PWM_PERIOD - 1;
+    TA1CCR1 = 0;
+    TA1CCTL0 = CCIE;
+    TA1CCTL1 = CCIE;
+    TA1CTL = TASSEL__ACLK | MC__UP | TACLR;
+
+    for (duty = 1; duty < LOAD_PWM_PERIOD; duty++) {
+        TA1CCR1 = duty;
+        __disable_interrupt();
+        SoftWait = periods;
+        while (SoftWait) {
+            POWER_PROFILE_SLEEP(POWER_LPM3, LPM3_bits + GIE); // Enter LPM3 w/ interrupts
+            __disable_interrupt();
+        }
+        __enable_interrupt();
+
+        if (loads_vcell() < LOAD_SAG_MV)
+            break;
+    }
+
+    TA1CTL = MC__STOP | TACLR;
+    TA1CCTL0 = 0;
+    TA1CCTL1 = 0;
+    if (duty < LOAD_PWM_PERIOD) {
+        *SoftOut &= ~SoftPin;
+        return 0;
+    }
+    *SoftOut |= SoftPin;
+    load_count(i, 1);
+    return 1;
+}
+
+
+//******************************************************************************
+// Rail Functions **************************************************************
+//******************************************************************************
+
+static uint16_t add_saturated(uint16_t a, uint16_t b)
+{
+    return (b < 0xFFFF - a) ? a + b : 0xFFFF;
+}
+
+// switches rail i, returns 0 if a soft-start had to give up
+static uint8_t load_switch(uint8_t i, uint8_t on)
+{
+    if (!on) {
+        *LoadRails[i].out &= ~LoadRails[i].pin;
+        LoadOn[i] = 0;
+        return 1;
+    }
+
+    LoadSinceOn = 0;
+    if (LoadRails[i].ramp_ms == 0) {
+        *LoadRails[i].out |= LoadRails[i].pin;
+    } else if (!load_soft_start(i)) {
+        LoadHold[i] = LoadBackoff[i];
+        if (LoadBackoff[i] < LOAD_BACKOFF_MAX_S)
+            LoadBackoff[i] *= 2;
+        return 0;
+    }
+    LoadBackoff[i] = LOAD_BACKOFF_S;
+    LoadOnTime[i] = 0;
+    LoadOn[i] = 1;
+    return 1;
+}
+
+// all rails off, called before the port lock is released
+void loads_init(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < LOAD_RAILS; i++) {
+        *LoadRails[i].out &= ~LoadRails[i].pin;
+        *LoadRails[i].dir |= LoadRails[i].pin;
+        LoadOn[i] = 0;
+        LoadBackoff[i] = LOAD_BACKOFF_S;
+        LoadHold[i] = 0;
+    }
+}
+
+// advances the rail timers by the seconds since the last call and switches at
+// most one rail, returns 1 if it did. A failed soft-start returns 0.
+uint8_t loads_update(uint32_t cap, uint16_t elapsed, uint8_t brownout)
+{
+    int8_t pick = -1;
+    uint8_t i;
+
+    LoadSinceOn = add_saturated(LoadSinceOn, elapsed);
+    for (i = 0; i < LOAD_RAILS; i++) {
+        if (LoadOn[i])
+            LoadOnTime[i] = add_saturated(LoadOnTime[i], elapsed);
+        LoadHold[i] = (LoadHold[i] > elapsed) ? LoadHold[i] - elapsed : 0;
+    }
+
+    // shed the least important rail that has to go
+    for (i = 0; i < LOAD_RAILS; i++) {
+        if (!LoadOn[i])
+            continue;
+        if (!brownout && (cap >= LoadRails[i].off_cap || LoadOnTime[i] < LoadRails[i].min_on))
+            continue;
+        if (pick < 0 || LoadRails[i].priority > LoadRails[pick].priority)
+            pick = i;
+    }
+    if (pick >= 0) {
+        load_switch(pick, 0);
+        return 1;
+    }
+    if (brownout || LoadSinceOn < LOAD_STAGGER_S)
+        return 0;
+
+    // switch on the most important rail that may come on
+    for (i = 0; i < LOAD_RAILS; i++) {
+        if (LoadOn[i] || cap <= LoadRails[i].on_cap || LoadHold[i])
+            continue;
+        if (pick < 0 || LoadRails[i].priority < LoadRails[pick].priority)
+            pick = i;
+    }
+    if (pick >= 0)
+        return load_switch(pick, 1);
+    return 0;
+}
+
+// cuts a rail whose work is done and keeps it off for hold_s, returns 1 if it
+// was on
+uint8_t loads_release(uint8_t rail, uint16_t hold_s)
+{
+    if (rail >= LOAD_RAILS || !LoadOn[rail])
+        return 0;
+    load_switch(rail, 0);
+    LoadHold[rail] = hold_s;
+    return 1;
+}
+
+uint8_t loads_on(uint8_t rail)
+{
+    return rail < LOAD_RAILS && LoadOn[rail];
+}
+
+void loads_suspend(void)
+{
+    uint8_t i;
+
+    FRAM_WRITE_ENABLE();
+    for (i = 0; i < LOAD_RAILS; i++) {
+        LoadSaved.backoff[i] = LoadBackoff[i];
+        LoadSaved.hold[i] = LoadHold[i];
+    }
+    LoadSaved.since_on = LoadSinceOn;
+    FRAM_WRITE_DISABLE();
+}
+
+// after loads_init() on a wake-up from LPM3.5
+void loads_resume(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < LOAD_RAILS; i++) {
+        LoadBackoff[i] = LoadSaved.backoff[i];
+        LoadHold[i] = LoadSaved.hold[i];
+    }
+    LoadSinceOn = LoadSaved.since_on;
+}
+
+uint8_t loads_active(void)
+{
+    uint8_t i, n = 0;
+
+    for (i = 0; i < LOAD_RAILS; i++)
+        n += LoadOn[i];
+    return n;
+}
+
+// lowest switch-on threshold of the rails that are off
+uint16_t loads_next_on(void)
+{
+    uint16_t cap = LOAD_NO_THRESHOLD;
+    uint8_t i;
+
+    for (i = 0; i < LOAD_RAILS; i++)
+        if (!LoadOn[i] && LoadRails[i].on_cap < cap)
+            cap = LoadRails[i].on_cap;
+    return cap;
+}
+
+// highest shed threshold of the rails that are on, 0 if none is on
+uint16_t loads_next_off(void)
+{
+    uint16_t cap = 0;
+    uint8_t i;
+
+    for (i = 0; i < LOAD_RAILS; i++)
+        if (LoadOn[i] && LoadRails[i].off_cap > cap)
+            cap = LoadRails[i].off_cap;
+    return cap;
+}
+
+// seconds until a pending switch may happen, 0 if none is pending
+uint16_t loads_poll(uint32_t cap)
+{
+    uint16_t wait = 0, left;
+    uint8_t i;
+
+    for (i = 0; i < LOAD_RAILS; i++) {
+        if (!LoadOn[i] && cap > LoadRails[i].on_cap) {
+            left = (LoadSinceOn < LOAD_STAGGER_S) ? LOAD_STAGGER_S - LoadSinceOn : 1;
+            if (LoadHold[i] > left)
+                left = LoadHold[i];
+        } else if (LoadOn[i] && cap < LoadRails[i].off_cap) {
+            left = (LoadOnTime[i] < LoadRails[i].min_on) ? LoadRails[i].min_on - LoadOnTime[i] : 1;
+        } else {
+            continue;
+        }
+        if (wait == 0 || left < wait)
+            wait = left;
+    }
+    return wait;
+}
+
+
+//******************************************************************************
+// Interrupts ******************************************************************
+//******************************************************************************
+
+// Timer1 CCR0, start of a PWM period: switch on, end the ramp step
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = TIMER1_A0_VECTOR
+__interrupt void Timer1_A0 (void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(TIMER1_A0_VECTOR))) Timer1_A0 (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    *SoftOut |= SoftPin;
+    // wake only at the end of a step, not during the VCell read that follows
+    if (SoftWait && --SoftWait == 0)
+        __bic_SR_register_on_exit(LPM3_bits);     // Exit LPM
+}
+
+
+// Timer1 CCR1, duty reached: switch off for the rest of the period
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector = TIMER1_A1_VECTOR
+__interrupt void Timer1_A1 (void)
+#elif defined(__GNUC__)
+void __attribute__ ((interrupt(TIMER1_A1_VECTOR))) Timer1_A1 (void)
+#else
+#error Compiler not supported!
+#endif
+{
+    switch(__even_in_range(TA1IV, TAIV__TAIFG))
+    {
+        case TAIV__TACCR1:
+            *SoftOut &= ~SoftPin;
+            break;
+        default: break;
+    }
+}
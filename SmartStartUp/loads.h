@@ -0,0 +1,75 @@
+//******************************************************************************
+// Load Manager ****************************************************************
+//******************************************************************************
+//
+// Table-driven switching of the load rails (LoadRails in loads.c). Every rail
+// has its own capacity thresholds, a minimum on-time and a priority:
+//
+//   - a rail is switched on above on_cap, the most important one first and
+//     at most one every LOAD_STAGGER_S so the inrush currents do not add up
+//   - a rail is shed below off_cap once it has been on for min_on seconds,
+//     the least important one first and one per update
+//   - when the cell drops below VEmpty (Status.Vmn) the least important rail
+//     is shed at once, min_on notwithstanding
+//
+// Give less important rails higher thresholds, so they come on last and go
+// off first while the capacity falls.
+//
+// A rail with ramp_ms is soft-started: TA1 drives its switch with a software
+// PWM on ACLK whose duty rises from 0 to 100 % over ramp_ms. Each step checks
+// VCell (loads_vcell()); below LOAD_SAG_MV the rail is switched off again and
+// not retried for a back-off time that doubles with every failed ramp. The
+// gauge refreshes VCell every 175 ms, so a ramp should take several of those.
+// Attempts and completed ramps per rail are counted in FRAM (LoadStarts).
+//
+// The timers live in RAM; loads_suspend() keeps them in FRAM over LPM3.5
+// (deep_sleep.h), which is only used while every rail is off.
+
+#ifndef LOADS_H
+#define LOADS_H
+
+#include <stdint.h>
+
+#define LOAD_STAGGER_S      2       // s between two switch-ons
+#define LOAD_NO_THRESHOLD   0xFFFF
+
+#define LOAD_PWM_PERIOD     32      // ACLK ticks, ~1 kHz and 32 duty steps
+#define LOAD_SAG_MV         3100    // mV, abort a ramp below this VCell
+#define LOAD_BACKOFF_S      4       // s, wait after the first failed ramp
+#define LOAD_BACKOFF_MAX_S  512     // s
+#define LOAD_RAILS_MAX      4
+#define LOAD_APP            0       // rail of the application, see app_link.h
+
+typedef struct LoadRailStruct{
+    volatile uint8_t *dir;  // PxDIR of the switch
+    volatile uint8_t *out;  // PxOUT of the switch
+    uint8_t pin;
+    uint8_t priority;       // 0 = most important, shed last
+    uint16_t on_cap;        // uAh, switch on above
+    uint16_t off_cap;       // uAh, shed below
+    uint16_t min_on;        // s
+    uint16_t ramp_ms;       // soft-start time, 0 switches hard
+} LoadRail;
+
+typedef struct LoadStartStruct{
+    uint16_t attempts;
+    uint16_t completed;
+} LoadStart;
+
+extern LoadStart LoadStarts[LOAD_RAILS_MAX];
+
+// supplied by the application: VCell in mV, called during soft-starts
+uint16_t loads_vcell(void);
+
+void loads_init(void);
+uint8_t loads_update(uint32_t cap, uint16_t elapsed, uint8_t brownout);
+uint8_t loads_release(uint8_t rail, uint16_t hold_s);
+uint8_t loads_on(uint8_t rail);
+uint8_t loads_active(void);
+uint16_t loads_next_on(void);
+uint16_t loads_next_off(void);
+uint16_t loads_poll(uint32_t cap);
+void loads_suspend(void);
+void loads_resume(void);
+
+#endif /* LOADS_H */
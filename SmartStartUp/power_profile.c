@@ -0,0 +1,70 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "fram.h"
+#include "timebase.h"
+#include "power_profile.h"
+
+#if POWER_PROFILE
+
+volatile PowerProfile PowerStats;
+
+#if defined(__TI_COMPILER_VERSION__)
+#pragma PERSISTENT(PowerStatsSaved)
+#endif
+FRAM_PERSISTENT PowerProfile PowerStatsSaved = {{{0}}, {0}};
+
+static uint32_t LastStamp = 0;
+static uint8_t CurrentMode = 0;
+static uint8_t CurrentState = POWER_ACTIVE;
+
+
+//******************************************************************************
+// Accounting ******************************************************************
+//******************************************************************************
+
+// adds the time since the last stamp to the current mode and state
+static void power_profile_account(void)
+{
+    uint32_t now = timebase_now();
+
+    PowerStats.ticks[CurrentMode][CurrentState] += now - LastStamp;
+    LastStamp = now;
+}
+
+// called at the top of every main loop iteration
+void power_profile_cycle(uint8_t mode)
+{
+    power_profile_account();
+    CurrentMode = (mode < POWER_MODES) ? mode : POWER_MODES - 1;
+    PowerStats.cycles[CurrentMode]++;
+}
+
+void power_profile_enter(uint8_t state)
+{
+    power_profile_account();
+    CurrentState = state;
+}
+
+void power_profile_exit(void)
+{
+    power_profile_account();
+    CurrentState = POWER_ACTIVE;
+}
+
+// copies the counters to FRAM, e.g. together with a log flush
+void power_profile_save(void)
+{
+    uint8_t i, j;
+
+    FRAM_WRITE_ENABLE();
+    for (i = 0; i < POWER_MODES; i++) {
+        for (j = 0; j < POWER_STATES; j++)
+            PowerStatsSaved.ticks[i][j] = PowerStats.ticks[i][j];
+        PowerStatsSaved.cycles[i] = PowerStats.cycles[i];
+    }
+    FRAM_WRITE_DISABLE();
+}
+
+#endif /* POWER_PROFILE */
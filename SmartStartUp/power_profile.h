@@ -0,0 +1,74 @@
+//******************************************************************************
+// Power State Accounting ******************************************************
+//******************************************************************************
+//
+// Optional instrumentation, enabled with POWER_PROFILE=1 in the compiler
+// defines. Every low-power-mode entry and exit is timestamped from the ACLK
+// timebase (see timebase.h, 30.5 us resolution), and the time is added to
+// PowerStats per main loop mode and per power state. Everything between two
+// LPM entries counts as active time. PowerStats can be watched in the
+// debugger; power_profile_save() keeps a copy in FRAM (PowerStatsSaved).
+//
+// POWER_PROFILE_SLEEP() also records the LPM entry and exit in the event
+// trace (see trace.h). With POWER_PROFILE=0 and TRACE=0 it expands to the
+// plain __bis_SR_register() and nothing else is compiled in.
+
+#ifndef POWER_PROFILE_H
+#define POWER_PROFILE_H
+
+#include <msp430.h>
+#include <stdint.h>
+#include "timebase.h"
+#include "trace.h"
+
+#define POWER_MODES     4   // main loop modes that are told apart
+
+typedef enum PowerStateEnum{
+    POWER_ACTIVE,
+    POWER_LPM0,     // waiting for an I2C/SPI ISR
+    POWER_LPM3,     // sleeping between samples
+    POWER_STATES
+} PowerState;
+
+typedef struct PowerProfileStruct{
+    uint32_t ticks[POWER_MODES][POWER_STATES];  // ACLK ticks
+    uint32_t cycles[POWER_MODES];               // main loop iterations
+} PowerProfile;
+
+#if POWER_PROFILE
+
+extern volatile PowerProfile PowerStats;
+extern PowerProfile PowerStatsSaved;
+
+void power_profile_cycle(uint8_t mode);
+void power_profile_enter(uint8_t state);
+void power_profile_exit(void);
+void power_profile_save(void);
+
+#else
+
+#define power_profile_cycle(mode)           ((void)(mode))
+#define power_profile_enter(state)          ((void)0)
+#define power_profile_exit()                ((void)0)
+#define power_profile_save()                ((void)0)
+
+#endif /* POWER_PROFILE */
+
+#if POWER_PROFILE || TRACE
+
+#define POWER_PROFILE_SLEEP(state, bits)    \
+    do {                                    \
+        TRACE_EVENT(TRACE_LPM_ENTER, state);\
+        power_profile_enter(state);         \
+        __bis_SR_register(bits);            \
+        power_profile_exit();               \
+        TRACE_EVENT(TRACE_LPM_EXIT, state); \
+    } while (0)
+
+#else
+
+#define POWER_PROFILE_SLEEP(state, bits)    __bis_SR_register(bits)
+
+#endif
+
+#endif /* POWER_PROFILE_H */
@@ -47,6 +47,29 @@ extern "C" {
 #define CRC8_INIT 0xFF
 #define CRC8_LEN 1
 
+/*
+ * Frames with constant contents are built by the preprocessor, so they can be
+ * const arrays in FRAM and go out without any runtime work. CRC-8 is linear:
+ * the eight shift steps over one byte are the XOR of the steps of its set
+ * bits, precomputed below for CRC8_POLYNOMIAL 0x31. SENSIRION_WORD_CRC(0xBEEF)
+ * is 0x92, as in the datasheets.
+ */
+#define SENSIRION_CRC8_SHIFT(c)                                              \
+    ((((c)&0x01) ? 0x31 : 0) ^ (((c)&0x02) ? 0x62 : 0) ^                     \
+     (((c)&0x04) ? 0xC4 : 0) ^ (((c)&0x08) ? 0xB9 : 0) ^                     \
+     (((c)&0x10) ? 0x43 : 0) ^ (((c)&0x20) ? 0x86 : 0) ^                     \
+     (((c)&0x40) ? 0x3D : 0) ^ (((c)&0x80) ? 0x7A : 0))
+#define SENSIRION_WORD_CRC(word)                                             \
+    SENSIRION_CRC8_SHIFT(SENSIRION_CRC8_SHIFT(CRC8_INIT ^ (((word) >> 8) & 0xFF)) \
+                         ^ ((word)&0xFF))
+
+/* initializer bytes: a command, a data word followed by its CRC */
+#define SENSIRION_FRAME_COMMAND(command) \
+    (uint8_t)((command) >> 8), (uint8_t)(command)
+#define SENSIRION_FRAME_WORD(word)                   \
+    (uint8_t)((word) >> 8), (uint8_t)(word),         \
+        (uint8_t)SENSIRION_WORD_CRC(word)
+
 #define SENSIRION_COMMAND_SIZE 2
 #define SENSIRION_WORD_SIZE 2
 #define SENSIRION_NUM_WORDS(x) (sizeof(x) / SENSIRION_WORD_SIZE)
@@ -6,37 +6,13 @@
 #include "sensirion_i2c_hal.h"
 #include "sensirion_common.h"
 #include "sensirion_config.h"
+#include "sensirion_i2c.h"
+#include "clock.h"
+#include "trace.h"
+#include "i2c_master.h"
 
 
 
-//******************************************************************************
-// General I2C State Machine ***************************************************
-//******************************************************************************
-
-typedef enum I2C_ModeEnum{
-    IDLE_MODE,
-    NACK_MODE,
-    TX_REG_ADDRESS_MODE,
-    RX_REG_ADDRESS_MODE,
-    TX_DATA_MODE,
-    RX_DATA_MODE,
-    SWITCH_TO_RX_MODE,
-    SWITCH_TO_TX_MODE,
-    TIMEOUT_MODE
-} I2C_Mode;
-
-
-/* Used to track the state of the software state machine*/
-extern I2C_Mode MasterMode;
-
-extern uint8_t TransmitRegAddr;
-extern uint8_t ReceiveBuffer[2];
-extern uint8_t RXByteCtr;
-extern uint8_t ReceiveIndex;
-extern uint8_t TransmitBuffer[2];
-extern uint8_t TXByteCtr;
-extern uint8_t TransmitIndex;
-
 void CopyArray(const uint8_t *source, uint8_t *dest, uint8_t count)
 {
     uint8_t copyIndex = 0;
@@ -67,10 +43,10 @@ void CopyArray(const uint8_t *source, uint8_t *dest, uint8_t count)
  * @returns         0 on success, an error code otherwise
  */
 int16_t sensirion_i2c_hal_select_bus(uint8_t bus_idx) {
-    /* TODO:IMPLEMENT or leave empty if all sensors are located on one single
-     * bus
+    /* All sensors share eUSCI_B0 and are told apart by their address, see
+     * Stc3x in stc3x_i2c.h
      */
-    return NOT_IMPLEMENTED_ERROR;
+    return bus_idx == 0 ? NO_ERROR : NOT_IMPLEMENTED_ERROR;
 }
 
 /**
@@ -101,11 +77,11 @@ void sensirion_i2c_hal_free(void) {
 int8_t sensirion_i2c_hal_read(uint8_t address, uint8_t* data, uint16_t count) {
 
     /* Initialize state machine */
-    MasterMode = SWITCH_TO_RX_MODE;
-    RXByteCtr = count;
-    TXByteCtr = 0;
-    ReceiveIndex = 0;
-    TransmitIndex = 0;
+    I2CBus.mode = SWITCH_TO_RX_MODE;
+    I2CBus.rx_count = count;
+    I2CBus.tx_count = 0;
+    I2CBus.rx_index = 0;
+    I2CBus.tx_index = 0;
 
     /* Initialize slave address and interrupts */
     UCB0I2CSA = address;
@@ -113,12 +89,16 @@ int8_t sensirion_i2c_hal_read(uint8_t address, uint8_t* data, uint16_t count) {
     UCB0IE |= UCRXIE;                       // Enable RX interrupt
     UCB0IE &= ~UCTXIE;                        // Disable TX interrupt
 
+    TRACE_EVENT(TRACE_I2C_START, address);
+    __disable_interrupt();
     UCB0CTLW0 |= UCTXSTT;             // start condition
     UCB0CTLW0 &= ~UCTR;               // I2C RX
+    i2c_wait();
+    TRACE_EVENT(TRACE_I2C_STOP, address);
 
-    __bis_SR_register(LPM0_bits + GIE);              // Enter LPM0 w/ interrupts
-
-    CopyArray(ReceiveBuffer, data, count);
+    if (I2CBus.mode == NACK_MODE)
+        return I2C_NACK_ERROR;
+    CopyArray(I2CBus.rx_buffer, data, count);
 
     return 0;
 }
@@ -138,15 +118,14 @@ int8_t sensirion_i2c_hal_write(uint8_t address, const uint8_t* data,
                                uint16_t count) {
 
     /* Initialize state machine */
-    MasterMode = TX_DATA_MODE;
+    I2CBus.mode = TX_DATA_MODE;
 
-    //Copy register data to TransmitBuffer
-    CopyArray(data, TransmitBuffer, count);
+    I2CBus.tx_data = data;                  // sent in place, the call blocks
 
-    TXByteCtr = count;
-    RXByteCtr = 0;
-    ReceiveIndex = 0;
-    TransmitIndex = 0;
+    I2CBus.tx_count = count;
+    I2CBus.rx_count = 0;
+    I2CBus.rx_index = 0;
+    I2CBus.tx_index = 0;
 
     /* Initialize slave address and interrupts */
     UCB0I2CSA = address;
@@ -154,9 +133,16 @@ int8_t sensirion_i2c_hal_write(uint8_t address, const uint8_t* data,
     UCB0IE &= ~UCRXIE;                       // Disable RX interrupt
     UCB0IE |= UCTXIE;                        // Enable TX interrupt
 
+    if (count >= 2)
+        TRACE_EVENT(TRACE_STC_CMD, data[1]);  // writes start with the command
+    TRACE_EVENT(TRACE_I2C_START, address);
+    __disable_interrupt();
     UCB0CTLW0 |= UCTR + UCTXSTT;             // I2C TX, start condition
-    __bis_SR_register(LPM0_bits + GIE);              // Enter LPM0 w/ interrupts
+    i2c_wait();
+    TRACE_EVENT(TRACE_I2C_STOP, address);
 
+    if (I2CBus.mode == NACK_MODE)
+        return I2C_NACK_ERROR;
     return 0;
 }
 
@@ -169,8 +155,8 @@ int8_t sensirion_i2c_hal_write(uint8_t address, const uint8_t* data,
  * @param useconds the sleep time in microseconds
  */
 void sensirion_i2c_hal_sleep_usec(uint32_t useconds) {
-    // const int cycles = 16*useconds;
-    _delay_cycles(160000);  // 10ms delay
+    // LPM3 on the clock module timer, rounded up to whole milliseconds
+    clock_sleep_ms((uint16_t)((useconds + 999) / 1000));
 }
 
 
@@ -42,10 +42,35 @@
 #include "sensirion_i2c_hal.h"
 #include <msp430.h>
 
+#define STC3X_COMMAND_SIZE 2
 
-#define STC3X_I2C_ADDRESS 0x29
-
-int16_t stc3x_set_binary_gas(uint16_t binary_gas) {
+/*
+ * Commands without arguments as constant frames, they are sent from FRAM as
+ * they are.
+ */
+static const uint8_t stc3x_measure_frame[] = {
+    SENSIRION_FRAME_COMMAND(0x3639)};
+static const uint8_t stc3x_enable_asc_frame[] = {
+    SENSIRION_FRAME_COMMAND(0x3FEF)};
+static const uint8_t stc3x_disable_asc_frame[] = {
+    SENSIRION_FRAME_COMMAND(0x3F6E)};
+static const uint8_t stc3x_prepare_read_state_frame[] = {
+    SENSIRION_FRAME_COMMAND(0x3752)};
+static const uint8_t stc3x_sensor_state_frame[] = {
+    SENSIRION_FRAME_COMMAND(0xE133)};
+static const uint8_t stc3x_apply_state_frame[] = {
+    SENSIRION_FRAME_COMMAND(0x3650)};
+static const uint8_t stc3x_self_test_frame[] = {
+    SENSIRION_FRAME_COMMAND(0x365B)};
+static const uint8_t stc3x_enter_sleep_mode_frame[] = {
+    SENSIRION_FRAME_COMMAND(0x3677)};
+static const uint8_t stc3x_prepare_product_identifier_frame[] = {
+    SENSIRION_FRAME_COMMAND(0x367C)};
+static const uint8_t stc3x_read_product_identifier_frame[] = {
+    SENSIRION_FRAME_COMMAND(0xE102)};
+
+
+int16_t stc3x_set_binary_gas(const Stc3x* sensor, uint16_t binary_gas) {
     int16_t error;
     uint8_t buffer[5];
     uint16_t offset = 0;
@@ -54,7 +79,7 @@ int16_t stc3x_set_binary_gas(uint16_t binary_gas) {
     offset =
         sensirion_i2c_add_uint16_t_to_buffer(&buffer[0], offset, binary_gas);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address, &buffer[0], offset);
     if (error) {
         return error;
     }
@@ -62,7 +87,8 @@ int16_t stc3x_set_binary_gas(uint16_t binary_gas) {
     return NO_ERROR;
 }
 
-int16_t stc3x_set_relative_humidity(uint16_t relative_humidity_ticks) {
+int16_t stc3x_set_relative_humidity(const Stc3x* sensor,
+                                    uint16_t relative_humidity_ticks) {
     int16_t error;
     uint8_t buffer[5];
     uint16_t offset = 0;
@@ -71,7 +97,7 @@ int16_t stc3x_set_relative_humidity(uint16_t relative_humidity_ticks) {
     offset = sensirion_i2c_add_uint16_t_to_buffer(&buffer[0], offset,
                                                   relative_humidity_ticks);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address, &buffer[0], offset);
     if (error) {
         return error;
     }
@@ -79,7 +105,7 @@ int16_t stc3x_set_relative_humidity(uint16_t relative_humidity_ticks) {
     return NO_ERROR;
 }
 
-int16_t stc3x_set_temperature(uint16_t temperature_ticks) {
+int16_t stc3x_set_temperature(const Stc3x* sensor, uint16_t temperature_ticks) {
     int16_t error;
     uint8_t buffer[5];
     uint16_t offset = 0;
@@ -88,7 +114,7 @@ int16_t stc3x_set_temperature(uint16_t temperature_ticks) {
     offset = sensirion_i2c_add_uint16_t_to_buffer(&buffer[0], offset,
                                                   temperature_ticks);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address, &buffer[0], offset);
     if (error) {
         return error;
     }
@@ -96,7 +122,7 @@ int16_t stc3x_set_temperature(uint16_t temperature_ticks) {
     return NO_ERROR;
 }
 
-int16_t stc3x_set_pressure(uint16_t absolute_pressure) {
+int16_t stc3x_set_pressure(const Stc3x* sensor, uint16_t absolute_pressure) {
     int16_t error;
     uint8_t buffer[5];
     uint16_t offset = 0;
@@ -105,7 +131,19 @@ int16_t stc3x_set_pressure(uint16_t absolute_pressure) {
     offset = sensirion_i2c_add_uint16_t_to_buffer(&buffer[0], offset,
                                                   absolute_pressure);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address, &buffer[0], offset);
+    if (error) {
+        return error;
+    }
+    sensirion_i2c_hal_sleep_usec(1000);
+    return NO_ERROR;
+}
+
+int16_t stc3x_set_frame(const Stc3x* sensor, const uint8_t* frame) {
+    int16_t error;
+
+    error = sensirion_i2c_write_data(sensor->i2c_address, frame,
+                                     STC3X_SET_FRAME_SIZE);
     if (error) {
         return error;
     }
@@ -113,21 +151,32 @@ int16_t stc3x_set_pressure(uint16_t absolute_pressure) {
     return NO_ERROR;
 }
 
-int16_t stc3x_measure_gas_concentration(uint16_t* gas_ticks,
+int16_t stc3x_measure_gas_concentration(const Stc3x* sensor,
+                                        uint16_t* gas_ticks,
                                         uint16_t* temperature_ticks) {
     int16_t error;
-    uint8_t buffer[6];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0x3639);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = stc3x_start_gas_concentration(sensor);
     if (error) {
         return error;
     }
+    sensirion_i2c_hal_sleep_usec(STC3X_MEASURE_US);
+    return stc3x_read_gas_concentration(sensor, gas_ticks, temperature_ticks);
+}
 
-    _delay_cycles(1600000); // 100ms delay ... //sensirion_i2c_hal_sleep_usec(70000);
+int16_t stc3x_start_gas_concentration(const Stc3x* sensor) {
+    return sensirion_i2c_write_data(sensor->i2c_address,
+                                    &stc3x_measure_frame[0],
+                                    STC3X_COMMAND_SIZE);
+}
 
-    error = sensirion_i2c_read_data_inplace(STC3X_I2C_ADDRESS, &buffer[0], 4);
+int16_t stc3x_read_gas_concentration(const Stc3x* sensor,
+                                     uint16_t* gas_ticks,
+                                     uint16_t* temperature_ticks) {
+    int16_t error;
+    uint8_t buffer[6];
+
+    error = sensirion_i2c_read_data_inplace(sensor->i2c_address, &buffer[0], 4);
     if (error) {
         return error;
     }
@@ -136,7 +185,55 @@ int16_t stc3x_measure_gas_concentration(uint16_t* gas_ticks,
     return NO_ERROR;
 }
 
-int16_t stc3x_forced_recalibration(uint16_t reference_concentration) {
+int16_t stc3x_start_all(const Stc3x* sensors, Stc3xSample* samples,
+                        uint8_t count) {
+    int16_t error = NOT_IMPLEMENTED_ERROR;
+    uint8_t started = 0;
+    uint8_t i;
+
+    for (i = 0; i < count; i++) {
+        samples[i].error = stc3x_start_gas_concentration(&sensors[i]);
+        if (samples[i].error) {
+            error = samples[i].error;
+        } else {
+            started = 1;
+        }
+    }
+    return started ? NO_ERROR : error;
+}
+
+int16_t stc3x_read_all(const Stc3x* sensors, Stc3xSample* samples,
+                       uint8_t count) {
+    int16_t error = NO_ERROR;
+    uint8_t i;
+
+    for (i = 0; i < count; i++) {
+        if (!samples[i].error) {
+            samples[i].error = stc3x_read_gas_concentration(
+                &sensors[i], &samples[i].gas_ticks,
+                &samples[i].temperature_ticks);
+        }
+        if (samples[i].error) {
+            error = samples[i].error;
+        }
+    }
+    return error;
+}
+
+int16_t stc3x_measure_all(const Stc3x* sensors, Stc3xSample* samples,
+                          uint8_t count) {
+    int16_t error;
+
+    error = stc3x_start_all(sensors, samples, count);
+    if (error) {
+        return error;
+    }
+    sensirion_i2c_hal_sleep_usec(STC3X_MEASURE_US);
+    return stc3x_read_all(sensors, samples, count);
+}
+
+int16_t stc3x_forced_recalibration(const Stc3x* sensor,
+                                   uint16_t reference_concentration) {
     int16_t error;
     uint8_t buffer[5];
     uint16_t offset = 0;
@@ -145,21 +242,20 @@ int16_t stc3x_forced_recalibration(uint16_t reference_concentration) {
     offset = sensirion_i2c_add_uint16_t_to_buffer(&buffer[0], offset,
                                                   reference_concentration);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address, &buffer[0], offset);
     if (error) {
         return error;
     }
-    _delay_cycles(1600000); // 100ms delay ... //sensirion_i2c_hal_sleep_usec(66000);
+    sensirion_i2c_hal_sleep_usec(STC3X_MEASURE_US);
     return NO_ERROR;
 }
 
-int16_t stc3x_enable_automatic_self_calibration(void) {
+int16_t stc3x_enable_automatic_self_calibration(const Stc3x* sensor) {
     int16_t error;
-    uint8_t buffer[2];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0x3FEF);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address,
+                                     &stc3x_enable_asc_frame[0],
+                                     STC3X_COMMAND_SIZE);
     if (error) {
         return error;
     }
@@ -167,13 +263,12 @@ int16_t stc3x_enable_automatic_self_calibration(void) {
     return NO_ERROR;
 }
 
-int16_t stc3x_disable_automatic_self_calibration(void) {
+int16_t stc3x_disable_automatic_self_calibration(const Stc3x* sensor) {
     int16_t error;
-    uint8_t buffer[2];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0x3F6E);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address,
+                                     &stc3x_disable_asc_frame[0],
+                                     STC3X_COMMAND_SIZE);
     if (error) {
         return error;
     }
@@ -181,13 +276,12 @@ int16_t stc3x_disable_automatic_self_calibration(void) {
     return NO_ERROR;
 }
 
-int16_t stc3x_prepare_read_state(void) {
+int16_t stc3x_prepare_read_state(const Stc3x* sensor) {
     int16_t error;
-    uint8_t buffer[2];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0x3752);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address,
+                                     &stc3x_prepare_read_state_frame[0],
+                                     STC3X_COMMAND_SIZE);
     if (error) {
         return error;
     }
@@ -195,7 +289,9 @@ int16_t stc3x_prepare_read_state(void) {
     return NO_ERROR;
 }
 
-int16_t stc3x_set_sensor_state(const uint8_t* state, uint8_t state_size) {
+int16_t stc3x_set_sensor_state(const Stc3x* sensor,
+                               const uint8_t* state,
+                               uint8_t state_size) {
     uint8_t buffer[47];
     uint16_t offset = 0;
     offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0xE133);
@@ -203,23 +299,26 @@ int16_t stc3x_set_sensor_state(const uint8_t* state, uint8_t state_size) {
     offset = sensirion_i2c_add_bytes_to_buffer(&buffer[0], offset, state,
                                                state_size);
 
-    return sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    return sensirion_i2c_write_data(sensor->i2c_address, &buffer[0], offset);
 }
 
-int16_t stc3x_get_sensor_state(uint8_t* state, uint8_t state_size) {
+int16_t stc3x_get_sensor_state(const Stc3x* sensor,
+                               uint8_t* state,
+                               uint8_t state_size) {
     int16_t error;
     uint8_t buffer[45];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0xE133);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address,
+                                     &stc3x_sensor_state_frame[0],
+                                     STC3X_COMMAND_SIZE);
     if (error) {
         return error;
     }
 
     sensirion_i2c_hal_sleep_usec(0);
 
-    error = sensirion_i2c_read_data_inplace(STC3X_I2C_ADDRESS, &buffer[0], 30);
+    error = sensirion_i2c_read_data_inplace(sensor->i2c_address, &buffer[0],
+                                            30);
     if (error) {
         return error;
     }
@@ -227,13 +326,12 @@ int16_t stc3x_get_sensor_state(uint8_t* state, uint8_t state_size) {
     return NO_ERROR;
 }
 
-int16_t stc3x_apply_state(void) {
+int16_t stc3x_apply_state(const Stc3x* sensor) {
     int16_t error;
-    uint8_t buffer[2];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0x3650);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address,
+                                     &stc3x_apply_state_frame[0],
+                                     STC3X_COMMAND_SIZE);
     if (error) {
         return error;
     }
@@ -241,20 +339,20 @@ int16_t stc3x_apply_state(void) {
     return NO_ERROR;
 }
 
-int16_t stc3x_self_test(uint16_t* self_test_output) {
+int16_t stc3x_self_test(const Stc3x* sensor, uint16_t* self_test_output) {
     int16_t error;
     uint8_t buffer[3];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0x365B);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address,
+                                     &stc3x_self_test_frame[0],
+                                     STC3X_COMMAND_SIZE);
     if (error) {
         return error;
     }
 
     sensirion_i2c_hal_sleep_usec(22000);
 
-    error = sensirion_i2c_read_data_inplace(STC3X_I2C_ADDRESS, &buffer[0], 2);
+    error = sensirion_i2c_read_data_inplace(sensor->i2c_address, &buffer[0], 2);
     if (error) {
         return error;
     }
@@ -262,13 +360,12 @@ int16_t stc3x_self_test(uint16_t* self_test_output) {
     return NO_ERROR;
 }
 
-int16_t stc3x_enter_sleep_mode(void) {
+int16_t stc3x_enter_sleep_mode(const Stc3x* sensor) {
     int16_t error;
-    uint8_t buffer[2];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0x3677);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address,
+                                     &stc3x_enter_sleep_mode_frame[0],
+                                     STC3X_COMMAND_SIZE);
     if (error) {
         return error;
     }
@@ -276,30 +373,30 @@ int16_t stc3x_enter_sleep_mode(void) {
     return NO_ERROR;
 }
 
-int16_t stc3x_prepare_product_identifier(void) {
-    uint8_t buffer[2];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0x367C);
-
-    return sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+int16_t stc3x_prepare_product_identifier(const Stc3x* sensor) {
+    return sensirion_i2c_write_data(sensor->i2c_address,
+                                    &stc3x_prepare_product_identifier_frame[0],
+                                    STC3X_COMMAND_SIZE);
 }
 
-int16_t stc3x_read_product_identifier(uint32_t* product_number,
+int16_t stc3x_read_product_identifier(const Stc3x* sensor,
+                                      uint32_t* product_number,
                                       uint8_t* serial_number,
                                       uint8_t serial_number_size) {
     int16_t error;
     uint8_t buffer[18];
-    uint16_t offset = 0;
-    offset = sensirion_i2c_add_command_to_buffer(&buffer[0], offset, 0xE102);
 
-    error = sensirion_i2c_write_data(STC3X_I2C_ADDRESS, &buffer[0], offset);
+    error = sensirion_i2c_write_data(sensor->i2c_address,
+                                     &stc3x_read_product_identifier_frame[0],
+                                     STC3X_COMMAND_SIZE);
     if (error) {
         return error;
     }
 
     sensirion_i2c_hal_sleep_usec(10000);
 
-    error = sensirion_i2c_read_data_inplace(STC3X_I2C_ADDRESS, &buffer[0], 12);
+    error = sensirion_i2c_read_data_inplace(sensor->i2c_address, &buffer[0],
+                                            12);
     if (error) {
         return error;
     }
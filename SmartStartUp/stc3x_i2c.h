@@ -44,6 +44,30 @@ extern "C" {
 #endif
 
 #include "sensirion_config.h"
+#include "sensirion_i2c.h"
+
+#define STC3X_MEASURE_US 70000  // gas concentration, < 66 ms per datasheet
+
+#define STC3X_I2C_ADDRESS 0x29      // default, strapped sensors go up to 0x2C
+#define STC3X_I2C_ADDRESS_LAST 0x2C
+
+/**
+ * Stc3x - Device handle, every function takes the sensor it talks to as its
+ * first argument. Several STC3x share one bus through their address straps.
+ */
+typedef struct Stc3xStruct {
+    uint8_t i2c_address;
+} Stc3x;
+
+/**
+ * Stc3xSample - Result of one sensor in a pipelined measurement, see
+ * stc3x_start_all().
+ */
+typedef struct Stc3xSampleStruct {
+    int16_t error;  // start or read error of this sensor, 0 if valid
+    uint16_t gas_ticks;
+    uint16_t temperature_ticks;
+} Stc3xSample;
 
 /**
  * stc3x_set_binary_gas() - The STC3x measures the concentration of binary gas
@@ -64,7 +88,7 @@ of available binary gases. STC31: - 0x0000: CO₂ in N₂ for range in 0 to 100
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_set_binary_gas(uint16_t binary_gas);
+int16_t stc3x_set_binary_gas(const Stc3x* sensor, uint16_t binary_gas);
 
 /**
  * stc3x_set_relative_humidity() - As mentioned in section 5.1 of the datasheet,
@@ -79,7 +103,8 @@ value is written to the sensor
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_set_relative_humidity(uint16_t relative_humidity_ticks);
+int16_t stc3x_set_relative_humidity(const Stc3x* sensor,
+                                    uint16_t relative_humidity_ticks);
 
 /**
  * stc3x_set_temperature() - The concentration measurement requires a
@@ -94,7 +119,7 @@ to the sensor is used until a new value is written to the sensor.
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_set_temperature(uint16_t temperature_ticks);
+int16_t stc3x_set_temperature(const Stc3x* sensor, uint16_t temperature_ticks);
 
 /**
  * stc3x_set_pressure() - A pressure value can be written into the sensor, for
@@ -108,7 +133,34 @@ assumed. The value written is used until a new value is written to the sensor.
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_set_pressure(uint16_t absolue_pressure);
+int16_t stc3x_set_pressure(const Stc3x* sensor, uint16_t absolue_pressure);
+
+/**
+ * STC3X_SET_*_FRAME() - Initializers for settings with a constant argument,
+ * CRC included, for stc3x_set_frame():
+ *
+ *     static const uint8_t air[] = STC3X_SET_BINARY_GAS_FRAME(0x0003);
+ */
+#define STC3X_SET_FRAME_SIZE 5
+#define STC3X_SET_BINARY_GAS_FRAME(binary_gas) \
+    {SENSIRION_FRAME_COMMAND(0x3615), SENSIRION_FRAME_WORD(binary_gas)}
+#define STC3X_SET_RELATIVE_HUMIDITY_FRAME(relative_humidity_ticks) \
+    {SENSIRION_FRAME_COMMAND(0x3624),                              \
+     SENSIRION_FRAME_WORD(relative_humidity_ticks)}
+#define STC3X_SET_TEMPERATURE_FRAME(temperature_ticks) \
+    {SENSIRION_FRAME_COMMAND(0x361E), SENSIRION_FRAME_WORD(temperature_ticks)}
+#define STC3X_SET_PRESSURE_FRAME(absolute_pressure) \
+    {SENSIRION_FRAME_COMMAND(0x362F), SENSIRION_FRAME_WORD(absolute_pressure)}
+
+/**
+ * stc3x_set_frame() - Sends a STC3X_SET_*_FRAME() as it is, like the
+ * stc3x_set_*() functions but without building the frame.
+ *
+ * @param frame STC3X_SET_FRAME_SIZE bytes
+ *
+ * @return 0 on success, an error code otherwise
+ */
+int16_t stc3x_set_frame(const Stc3x* sensor, const uint8_t* frame);
 
 /**
  * stc3x_measure_gas_concentration() - The measurement of gas concentration is
@@ -136,9 +188,64 @@ triggered more often than once a second.
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_measure_gas_concentration(uint16_t* gas_ticks,
+int16_t stc3x_measure_gas_concentration(const Stc3x* sensor,
+                                        uint16_t* gas_ticks,
                                         uint16_t* temperature_ticks);
 
+/**
+ * stc3x_start_gas_concentration() - Sends the measurement command of
+ * stc3x_measure_gas_concentration() and returns at once. The result can be
+ * read with stc3x_read_gas_concentration() STC3X_MEASURE_US later, the bus is
+ * free for other devices meanwhile.
+ *
+ * @return 0 on success, an error code otherwise
+ */
+int16_t stc3x_start_gas_concentration(const Stc3x* sensor);
+
+/**
+ * stc3x_read_gas_concentration() - Reads the result of a measurement started
+ * with stc3x_start_gas_concentration().
+ *
+ * @param gas_ticks Gas concentration, see stc3x_measure_gas_concentration()
+ *
+ * @param temperature_ticks Temperature, see stc3x_measure_gas_concentration()
+ *
+ * @return 0 on success, an error code otherwise
+ */
+int16_t stc3x_read_gas_concentration(const Stc3x* sensor,
+                                     uint16_t* gas_ticks,
+                                     uint16_t* temperature_ticks);
+
+/**
+ * stc3x_start_all() - Starts a measurement on each sensor, back to back. The
+ * conversions run in parallel, so all results can be read with
+ * stc3x_read_all() STC3X_MEASURE_US after this returns.
+ *
+ * @param samples One per sensor, the error of each start is kept here
+ *
+ * @return 0 if at least one sensor started, the last error otherwise
+ */
+int16_t stc3x_start_all(const Stc3x* sensors, Stc3xSample* samples,
+                        uint8_t count);
+
+/**
+ * stc3x_read_all() - Reads the results of stc3x_start_all(), sensors that did
+ * not start are skipped.
+ *
+ * @return 0 if every sensor has a result, the last error otherwise
+ */
+int16_t stc3x_read_all(const Stc3x* sensors, Stc3xSample* samples,
+                       uint8_t count);
+
+/**
+ * stc3x_measure_all() - stc3x_start_all(), one wait for the conversion time
+ * and stc3x_read_all(). N sensors take about one conversion, not N.
+ *
+ * @return 0 if every sensor has a result, an error code otherwise
+ */
+int16_t stc3x_measure_all(const Stc3x* sensors, Stc3xSample* samples,
+                          uint8_t count);
+
 /**
  * stc3x_forced_recalibration() - Forced recalibration (FRC) is used to improve
  * the sensor output with a known reference value. See the Field Calibration
@@ -151,7 +258,8 @@ int16_t stc3x_measure_gas_concentration(uint16_t* gas_ticks,
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_forced_recalibration(uint16_t reference_concentration);
+int16_t stc3x_forced_recalibration(const Stc3x* sensor,
+                                   uint16_t reference_concentration);
 
 /**
  * stc3x_enable_automatic_self_calibration() - Enable the automatic
@@ -170,7 +278,7 @@ instructions
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_enable_automatic_self_calibration(void);
+int16_t stc3x_enable_automatic_self_calibration(const Stc3x* sensor);
 
 /**
  * stc3x_disable_automatic_self_calibration() - Disable the automatic
@@ -185,7 +293,7 @@ default state of the sensor.
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_disable_automatic_self_calibration(void);
+int16_t stc3x_disable_automatic_self_calibration(const Stc3x* sensor);
 
 /**
  * stc3x_prepare_read_state() - The sensor will prepare its current state to be
@@ -195,7 +303,7 @@ int16_t stc3x_disable_automatic_self_calibration(void);
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_prepare_read_state(void);
+int16_t stc3x_prepare_read_state(const Stc3x* sensor);
 
 /**
  * stc3x_set_sensor_state() - Write the sensor state as read out earlier.
@@ -204,7 +312,9 @@ int16_t stc3x_prepare_read_state(void);
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_set_sensor_state(const uint8_t* state, uint8_t state_size);
+int16_t stc3x_set_sensor_state(const Stc3x* sensor,
+                               const uint8_t* state,
+                               uint8_t state_size);
 
 /**
  * stc3x_get_sensor_state() - Read out the sensor state.
@@ -213,7 +323,9 @@ int16_t stc3x_set_sensor_state(const uint8_t* state, uint8_t state_size);
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_get_sensor_state(uint8_t* state, uint8_t state_size);
+int16_t stc3x_get_sensor_state(const Stc3x* sensor,
+                               uint8_t* state,
+                               uint8_t state_size);
 
 /**
  * stc3x_apply_state() - The sensor will apply the written state data.
@@ -222,7 +334,7 @@ int16_t stc3x_get_sensor_state(uint8_t* state, uint8_t state_size);
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_apply_state(void);
+int16_t stc3x_apply_state(const Stc3x* sensor);
 
 /**
  * stc3x_self_test() - The sensor will run an on-chip self-test. A successful
@@ -236,7 +348,7 @@ of a successful self-test the sensor returns 0x0000 with correct CRC.
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_self_test(uint16_t* self_test_output);
+int16_t stc3x_self_test(const Stc3x* sensor, uint16_t* self_test_output);
 
 /**
  * stc3x_enter_sleep_mode() - Put sensor into sleep mode.
@@ -255,7 +367,7 @@ the sensor has received the address and has woken up. This takes maximum 12ms.
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_enter_sleep_mode(void);
+int16_t stc3x_enter_sleep_mode(const Stc3x* sensor);
 
 /**
  * stc3x_prepare_product_identifier() - Prepare for reading the product
@@ -263,7 +375,7 @@ int16_t stc3x_enter_sleep_mode(void);
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_prepare_product_identifier(void);
+int16_t stc3x_prepare_product_identifier(const Stc3x* sensor);
 
 /**
  * stc3x_read_product_identifier() - Read the product identifier and sensor
@@ -278,7 +390,8 @@ is listed below: STC31: 0x08010301
  *
  * @return 0 on success, an error code otherwise
  */
-int16_t stc3x_read_product_identifier(uint32_t* product_number,
+int16_t stc3x_read_product_identifier(const Stc3x* sensor,
+                                      uint32_t* product_number,
                                       uint8_t* serial_number,
                                       uint8_t serial_number_size);
 
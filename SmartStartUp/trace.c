@@ -0,0 +1,33 @@
+//******************************************************************************
+
+#include <msp430.h>
+#include <stdint.h>
+#include "trace.h"
+
+#if TRACE
+
+TraceBuffer Trace;
+
+
+//******************************************************************************
+// Trace Functions *************************************************************
+//******************************************************************************
+
+// also called from interrupts, the slot is claimed with interrupts disabled
+void trace_event(uint8_t id, uint8_t arg)
+{
+    uint16_t state = __get_interrupt_state();
+    TraceEvent *event;
+
+    __disable_interrupt();
+    event = &Trace.event[Trace.head];
+    Trace.head = (Trace.head + 1) & (TRACE_EVENTS - 1);
+    if (Trace.head == 0)
+        Trace.full = 1;
+    event->time = timebase_ticks();
+    event->id = id;
+    event->arg = arg;
+    __set_interrupt_state(state);
+}
+
+#endif /* TRACE */
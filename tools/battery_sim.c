@@ -0,0 +1,369 @@
+//******************************************************************************
+// Battery-life simulator for the AdaptiveSampling and SmartStartUp policies
+//
+// Replays the main loop of either firmware cycle by cycle against a current
+// model and integrates the charge drawn from (and, for SmartStartUp, harvested
+// into) the battery. Mode decisions use the same integer SoC / capacity and
+// thresholds as the firmware. Prints the runtime, the number of samples, the
+// time spent in each mode and where the charge went.
+//
+// Every model and policy value has a default below and can be changed in a
+// "key = value" file (-f, '#' starts a comment) or on the command line (-s).
+// -p reads a dump of PowerStatsSaved (POWER_PROFILE=1, 64 bytes) and replaces
+// the modelled active and LPM0 time per cycle with the measured averages.
+//
+// Build:  gcc -O2 -o battery_sim battery_sim.c
+// Usage:  ./battery_sim [-f model.txt] [-p power.bin] [-s key=value ...]
+//         ./battery_sim -s threshold_soc=40 -s period_saving_s=16
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ParamStruct{
+    const char *key;
+    double value;
+    const char *help;
+} Param;
+
+static Param params[] = {
+    // policy
+    {"policy",                      0,      "0 = AdaptiveSampling, 1 = SmartStartUp"},
+    {"capacity_mAh",                60,     "DesignCap"},
+    {"initial_soc",                 100,    "% at start"},
+    {"saving_enter_soc",            10,     "AdaptiveSampling: CRITICAL -> POWERSAVING above"},
+    {"saving_exit_soc",             5,      "AdaptiveSampling: POWERSAVING -> CRITICAL below"},
+    {"threshold_soc",               30,     "AdaptiveSampling: POWERSAVING -> NORMAL above"},
+    {"threshold_soc_hysteresis",    20,     "AdaptiveSampling: NORMAL -> POWERSAVING below"},
+    {"performance_enter_soc",       80,     "AdaptiveSampling: NORMAL -> PERFORMANCE above, charging"},
+    {"performance_exit_soc",        70,     "AdaptiveSampling: PERFORMANCE -> NORMAL below"},
+    {"period_critical_s",           60,     "AdaptiveSampling: CRITICAL sleep"},
+    {"period_saving_s",             8,      "AdaptiveSampling: POWERSAVING sleep"},
+    {"period_normal_s",             1,      "AdaptiveSampling: NORMAL sleep"},
+    {"period_performance_s",        0.5,    "AdaptiveSampling: PERFORMANCE sleep"},
+    {"threshold_cap_uAh",           1000,   "SmartStartUp: CHARGING -> BOOTING above"},
+    {"threshold_cap_hysteresis_uAh", 900,   "SmartStartUp: BOOTING -> CHARGING below"},
+    {"period_charging_s",           16,     "SmartStartUp: CHARGING sleep"},
+    {"period_booting_s",            1,      "SmartStartUp: BOOTING sleep"},
+    {"harvest_uA",                  0,      "average charging current"},
+    {"app_uA",                      3000,   "SmartStartUp: application load while BOOTING"},
+    {"max_days",                    365,    "stop after this time"},
+    // current model
+    {"mcu_active_uA",               2000,   "MSP430 at 16 MHz"},
+    {"mcu_lpm0_uA",                 420,    "MSP430 LPM0, waiting for I2C/SPI"},
+    {"mcu_lpm3_uA",                 1.3,    "MSP430 LPM3 with XT1"},
+    {"mcu_lpm35_uA",                0.7,    "MSP430 LPM3.5 with RTC on XT1, 0 = no deep sleep"},
+    {"deep_boot_ms",                3,      "wake-up reset and context restore after LPM3.5"},
+    {"active_ms",                   2,      "CPU work per cycle without waits"},
+    {"i2c_ms",                      2.5,    "LPM0 time of the gauge and STC31 transfers"},
+    {"stc31_measure_uA",            1100,   "STC31 during a measurement"},
+    {"stc31_measure_ms",            70,     "conversion, overlaps the gauge reads and drawing"},
+    {"stc31_idle_uA",               1,      "STC31 between measurements"},
+    {"lcd_update_ms",               95,     "display_update(), CPU in LPM0"},
+    {"lcd_update_uA",               50,     "LCD during an update"},
+    {"lcd_static_uA",               2,      "LCD holding the image"},
+    {"gauge_uA",                    7,      "MAX17260, hibernate and active mix"},
+};
+
+#define PARAMS      (sizeof(params) / sizeof(params[0]))
+#define P(name)     param(name)
+
+// measured per-cycle times from a PowerProfile dump, < 0 when not given
+static double measured_active_ms[4] = {-1, -1, -1, -1};
+static double measured_lpm0_ms[4] = {-1, -1, -1, -1};
+
+static double param(const char *key)
+{
+    unsigned i;
+
+    for (i = 0; i < PARAMS; i++)
+        if (strcmp(params[i].key, key) == 0)
+            return params[i].value;
+    fprintf(stderr, "unknown parameter %s\n", key);
+    exit(1);
+}
+
+static int set_param(char *line)
+{
+    char *eq = strchr(line, '='), *key, *end;
+    unsigned i;
+
+    if (!eq)
+        return -1;
+    *eq = 0;
+    key = strtok(line, " \t");
+    for (i = 0; key && i < PARAMS; i++) {
+        if (strcmp(params[i].key, key) == 0) {
+            params[i].value = strtod(eq + 1, &end);
+            return end == eq + 1 ? -1 : 0;
+        }
+    }
+    return -1;
+}
+
+static int load_model(const char *path)
+{
+    char line[256], *hash;
+    FILE *f = fopen(path, "r");
+    int n = 0;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        n++;
+        if ((hash = strchr(line, '#')) != NULL)
+            *hash = 0;
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+        if (set_param(line) < 0) {
+            fprintf(stderr, "%s:%d: bad line\n", path, n);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// PowerProfile: ticks[4][3] (active, LPM0, LPM3) then cycles[4], ACLK ticks
+static int load_profile(const char *path)
+{
+    uint8_t raw[64];
+    FILE *f = fopen(path, "rb");
+    int mode;
+
+    if (!f || fread(raw, 1, sizeof(raw), f) != sizeof(raw)) {
+        fprintf(stderr, "%s: expected a 64 byte PowerProfile dump\n", path);
+        if (f)
+            fclose(f);
+        return -1;
+    }
+    fclose(f);
+    for (mode = 0; mode < 4; mode++) {
+        uint32_t cycles = get32(&raw[48 + 4 * mode]);
+
+        if (cycles == 0)
+            continue;
+        measured_active_ms[mode] = get32(&raw[12 * mode]) * 1000.0 / 32768 / cycles;
+        measured_lpm0_ms[mode] = get32(&raw[12 * mode + 4]) * 1000.0 / 32768 / cycles;
+        fprintf(stderr, "mode %d: %u cycles, %.2f ms active, %.2f ms LPM0 per cycle\n",
+                mode, cycles, measured_active_ms[mode], measured_lpm0_ms[mode]);
+    }
+    return 0;
+}
+
+
+//******************************************************************************
+// Simulation ******************************************************************
+//******************************************************************************
+
+enum { SINK_ACTIVE, SINK_LPM0, SINK_LPM3, SINK_STC31, SINK_LCD, SINK_GAUGE, SINK_APP, SINKS };
+
+static const char *sink_names[SINKS] = {
+    "MCU active", "MCU LPM0", "MCU LPM3", "STC31", "LCD", "gauge", "application"
+};
+
+typedef struct SimStruct{
+    double charge_uAs;          // remaining
+    double time_s;
+    double mode_time_s[4];
+    unsigned long cycles[4];
+    unsigned long switches;
+    double sink_uAs[SINKS];
+} Sim;
+
+// one main loop iteration: the wake work, then 'sleep_s' in LPM3, or in
+// LPM3.5 with 'deep'. 'display' and 'sensor' select the work done.
+static void run_cycle(Sim *s, int mode, int sensor, int display, int deep, double sleep_s,
+                      double load_uA)
+{
+    double active_s = P("active_ms") / 1000;
+    double lpm0_s = (P("i2c_ms") + (display ? P("lcd_update_ms") : 0)) / 1000;
+    double wait_s = 0, awake_s, period_s, used[SINKS];
+    int i;
+
+    if (measured_active_ms[mode] >= 0) {
+        active_s = measured_active_ms[mode] / 1000;
+        lpm0_s = measured_lpm0_ms[mode] / 1000;
+    }
+    deep = deep && P("mcu_lpm35_uA") > 0 && sleep_s >= 2;  // DEEP_SLEEP_MIN_S
+    if (deep)
+        active_s += P("deep_boot_ms") / 1000;
+    if (sensor)     // LPM3 for what the wake work leaves of the conversion
+        wait_s = (P("stc31_measure_ms") - P("active_ms") - P("i2c_ms")) / 1000;
+    if (wait_s < 0)
+        wait_s = 0;
+    awake_s = active_s + lpm0_s + wait_s;
+    period_s = awake_s + sleep_s;
+
+    used[SINK_ACTIVE] = P("mcu_active_uA") * active_s;
+    used[SINK_LPM0] = P("mcu_lpm0_uA") * lpm0_s;
+    used[SINK_LPM3] = P(deep ? "mcu_lpm35_uA" : "mcu_lpm3_uA") * sleep_s +
+        P("mcu_lpm3_uA") * wait_s;
+    used[SINK_STC31] = sensor ?     // tiers without measurement switch it off
+        P("stc31_idle_uA") * period_s +
+        (P("stc31_measure_uA") - P("stc31_idle_uA")) * P("stc31_measure_ms") / 1000 : 0;
+    used[SINK_LCD] = P("lcd_static_uA") * period_s +
+        (display ? P("lcd_update_uA") * P("lcd_update_ms") / 1000 : 0);
+    used[SINK_GAUGE] = P("gauge_uA") * period_s;
+    used[SINK_APP] = load_uA * period_s;
+
+    for (i = 0; i < SINKS; i++) {
+        s->sink_uAs[i] += used[i];
+        s->charge_uAs -= used[i];
+    }
+    s->charge_uAs += P("harvest_uA") * period_s;
+    if (s->charge_uAs > P("capacity_mAh") * 3.6e6)
+        s->charge_uAs = P("capacity_mAh") * 3.6e6;
+    s->time_s += period_s;
+    s->mode_time_s[mode] += period_s;
+    s->cycles[mode]++;
+}
+
+// RepSOC as the firmware sees it, rounded to whole percent
+static unsigned soc(const Sim *s)
+{
+    double pct = s->charge_uAs / (P("capacity_mAh") * 3.6e6) * 100;
+
+    return pct <= 0 ? 0 : (unsigned)(pct + 0.5);
+}
+
+// AdaptiveSampling mode ladder, see ModeLadder in AdaptiveSampling_main.c
+typedef struct TierStruct{
+    const char *period, *enter, *exit;  // parameter names
+    int sensor, display, charging, deep;
+} Tier;
+
+static const Tier tiers[4] = {
+    {"period_critical_s",    NULL,                    NULL,                       0, 0, 0, 1},
+    {"period_saving_s",      "saving_enter_soc",      "saving_exit_soc",          1, 1, 0, 1},
+    {"period_normal_s",      "threshold_soc",         "threshold_soc_hysteresis", 1, 1, 0, 0},
+    {"period_performance_s", "performance_enter_soc", "performance_exit_soc",     1, 1, 1, 0},
+};
+
+// CRITICAL = 0, POWERSAVING = 1, NORMAL = 2, PERFORMANCE = 3. The firmware
+// steps after the measurement, the whole cycle is counted in the new tier.
+static void simulate_adaptive(Sim *s)
+{
+    double limit = P("max_days") * 86400;
+    double before = s->charge_uAs;
+    int mode = 2, next, charging = 0;
+    unsigned pct;
+
+    while (s->charge_uAs > 0 && s->time_s < limit) {
+        pct = soc(s);
+        next = mode;
+        if (mode > 0 && (pct < P(tiers[mode].exit) || (tiers[mode].charging && !charging)))
+            next = mode - 1;
+        else if (mode < 3 && pct > P(tiers[mode + 1].enter) &&
+                 (!tiers[mode + 1].charging || charging))
+            next = mode + 1;
+        if (next != mode)
+            s->switches++;
+        mode = next;
+
+        before = s->charge_uAs;
+        run_cycle(s, mode, tiers[mode].sensor, tiers[mode].display, tiers[mode].deep,
+                  P(tiers[mode].period), 0);
+        charging = s->charge_uAs > before;  // AvgCurrent > 0
+    }
+}
+
+// SmartStartUp: CHARGING = 0, BOOTING = 1, no sensor or display
+static void simulate_smartstartup(Sim *s)
+{
+    double limit = P("max_days") * 86400;
+    double cap_uAs = P("capacity_mAh") * 3.6e6;
+    int mode = 0;
+
+    while (s->charge_uAs > 0 && s->time_s < limit) {
+        double cap_uAh = s->charge_uAs / 3600;
+
+        if (mode == 0 && cap_uAh > P("threshold_cap_uAh")) {
+            mode = 1;
+            s->switches++;
+        } else if (mode == 1 && cap_uAh < P("threshold_cap_hysteresis_uAh")) {
+            mode = 0;
+            s->switches++;
+        }
+        if (mode == 0)
+            run_cycle(s, mode, 0, 0, 1, P("period_charging_s"), 0);
+        else
+            run_cycle(s, mode, 0, 0, 0, P("period_booting_s"), P("app_uA"));
+        if (s->charge_uAs >= cap_uAs && mode == 1 && P("harvest_uA") >= P("app_uA"))
+            break;  // energy neutral, runs forever
+    }
+}
+
+static void print_duration(const char *label, double seconds)
+{
+    printf("%-24s %10.2f h  (%.2f d)\n", label, seconds / 3600, seconds / 86400);
+}
+
+int main(int argc, char **argv)
+{
+    const char *names[2][4] = {{"CRITICAL", "POWERSAVING", "NORMAL", "PERFORMANCE"},
+                               {"CHARGING", "BOOTING"}};
+    double total = 0;
+    Sim s;
+    int i, policy;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            if (load_model(argv[++i]) < 0)
+                return 1;
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            if (load_profile(argv[++i]) < 0)
+                return 1;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            if (set_param(argv[++i]) < 0) {
+                fprintf(stderr, "bad parameter %s\n", argv[i]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [-f model.txt] [-p power.bin] [-s key=value ...]\n\n",
+                    argv[0]);
+            for (i = 0; i < (int)PARAMS; i++)
+                fprintf(stderr, "  %-30s %8g  %s\n", params[i].key, params[i].value,
+                        params[i].help);
+            return 1;
+        }
+    }
+
+    memset(&s, 0, sizeof(s));
+    s.charge_uAs = P("capacity_mAh") * 3.6e6 * P("initial_soc") / 100;
+    policy = P("policy") != 0;
+    if (policy)
+        simulate_smartstartup(&s);
+    else
+        simulate_adaptive(&s);
+
+    print_duration(s.charge_uAs > 0 ? "runtime (limit reached)" : "runtime", s.time_s);
+    for (i = 0; i < (policy ? 2 : 4); i++) {
+        printf("%-24s %10.2f h  %lu cycles\n", names[policy][i],
+               s.mode_time_s[i] / 3600, s.cycles[i]);
+    }
+    if (!policy)
+        printf("%-24s %10lu\n", "samples", s.cycles[1] + s.cycles[2] + s.cycles[3]);
+    for (i = 0; i < SINKS; i++)
+        total += s.sink_uAs[i];
+    printf("%-24s %10lu\n", "mode switches", s.switches);
+    printf("%-24s %10.2f uA\n", "average current", s.time_s > 0 ? total / s.time_s : 0);
+    printf("\ncharge by consumer\n");
+    for (i = 0; i < SINKS; i++) {
+        if (s.sink_uAs[i] == 0)
+            continue;
+        printf("  %-22s %10.3f mAh  %5.1f %%\n", sink_names[i], s.sink_uAs[i] / 3.6e6,
+               total > 0 ? s.sink_uAs[i] / total * 100 : 0);
+    }
+    return 0;
+}
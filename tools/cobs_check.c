@@ -0,0 +1,225 @@
+//******************************************************************************
+// Host loopback check of the UART export framing (cobs.h)
+//
+// Frames random payloads the way uart_export.c does (payload, CRC-16 little
+// endian, COBS, 0x00 delimiter) into one wire buffer and receives them again
+// the way tools/log_receive does. Checks:
+//   - the CRC against the CCITT-FALSE check value
+//   - every clean frame comes back unchanged, contains no 0x00 and stays
+//     within COBS_MAX_OVERHEAD, including 254-byte runs and all-zero payloads
+//   - after random bit flips, dropped bytes and inserted delimiters every
+//     untouched frame is still received, and damaged frames are rejected
+//     (a CRC-16 lets about 1 in 65536 through, reported as false accepts)
+// Exits with 1 on a failure.
+//
+// Build:  gcc -O2 -I../AdaptiveSampling -o cobs_check cobs_check.c ../AdaptiveSampling/cobs.c
+// Usage:  ./cobs_check
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "cobs.h"
+
+#define PAYLOAD_MAX     300
+#define FRAME_MAX       (PAYLOAD_MAX + 2 + COBS_MAX_OVERHEAD(PAYLOAD_MAX + 2) + 1)
+#define FRAMES          20000
+#define ROUNDS          20
+
+typedef struct SentStruct{
+    uint16_t start;         // first wire byte of the frame
+    uint16_t end;           // its delimiter
+    uint16_t length;
+    uint8_t payload[PAYLOAD_MAX];
+} Sent;
+
+static Sent Frames[64];
+static uint8_t Wire[64 * FRAME_MAX];
+static uint32_t Seed = 4711;
+
+static uint32_t rnd(void)
+{
+    Seed = Seed * 1103515245UL + 12345;
+    return (Seed >> 8) & 0xFFFFFF;
+}
+
+// payloads with the awkward cases for COBS: zeros, long non-zero runs
+static uint16_t make_payload(uint8_t *payload)
+{
+    uint16_t length = (uint16_t)(rnd() % (PAYLOAD_MAX + 1));
+    uint8_t style = (uint8_t)(rnd() % 4);
+    uint16_t i;
+
+    for (i = 0; i < length; i++) {
+        switch (style) {
+            case 0:  payload[i] = (uint8_t)rnd(); break;
+            case 1:  payload[i] = 0; break;
+            case 2:  payload[i] = (uint8_t)(1 + rnd() % 255); break;   // no zeros
+            default: payload[i] = (rnd() % 8) ? 0 : (uint8_t)rnd(); break;
+        }
+    }
+    return length;
+}
+
+// like send_frame() in uart_export.c, returns the wire length with delimiter
+static uint16_t frame(const uint8_t *payload, uint16_t length, uint8_t *out)
+{
+    uint8_t raw[PAYLOAD_MAX + 2];
+    uint16_t crc = crc16_ccitt(payload, length);
+    uint16_t n;
+
+    memcpy(raw, payload, length);
+    raw[length] = (uint8_t)crc;
+    raw[length + 1] = (uint8_t)(crc >> 8);
+    n = cobs_encode(raw, length + 2, out);
+    out[n] = 0;
+    return n + 1;
+}
+
+// like the receiver: returns the payload length or -1 if the frame is rejected
+static int unframe(const uint8_t *in, uint16_t length, uint8_t *payload)
+{
+    uint8_t raw[FRAME_MAX];
+    uint16_t n;
+
+    if (length == 0 || length > FRAME_MAX)
+        return -1;
+    n = cobs_decode(in, length, raw);
+    if (n < 2 || n - 2 > PAYLOAD_MAX)
+        return -1;
+    if (crc16_ccitt(raw, n - 2) != (uint16_t)(raw[n - 2] | (raw[n - 1] << 8)))
+        return -1;
+    memcpy(payload, raw, n - 2);
+    return n - 2;
+}
+
+static int check_crc(void)
+{
+    uint16_t crc = crc16_ccitt((const uint8_t *)"123456789", 9);
+
+    printf("crc check value    %s 0x%04X\n", crc == 0x29B1 ? "ok  " : "FAIL", crc);
+    return crc != 0x29B1;
+}
+
+static int check_clean(void)
+{
+    uint8_t payload[PAYLOAD_MAX], out[PAYLOAD_MAX], wire[FRAME_MAX];
+    uint32_t f;
+
+    for (f = 0; f < FRAMES; f++) {
+        uint16_t length = make_payload(payload);
+        uint16_t n = frame(payload, length, wire);
+        int received;
+
+        if (n - 1 > length + 2 + COBS_MAX_OVERHEAD(length + 2) ||
+            memchr(wire, 0, n - 1)) {
+            printf("clean frames       FAIL: frame %lu badly encoded\n", (unsigned long)f);
+            return 1;
+        }
+        received = unframe(wire, n - 1, out);
+        if (received != length || memcmp(payload, out, length)) {
+            printf("clean frames       FAIL: frame %lu (%u bytes) changed\n",
+                   (unsigned long)f, length);
+            return 1;
+        }
+    }
+    printf("clean frames       ok   %u frames\n", FRAMES);
+    return 0;
+}
+
+// one round: 64 frames on the wire, some damaged, all received
+static int check_damaged_round(unsigned long *damaged, unsigned long *rejected,
+                               unsigned long *fragments, unsigned long *false_accepts)
+{
+    uint8_t touched[64];
+    uint8_t payload[PAYLOAD_MAX];
+    uint16_t length = 0, start = 0, i;
+    uint8_t f, expect = 0;
+
+    for (f = 0; f < 64; f++) {
+        Frames[f].length = make_payload(Frames[f].payload);
+        Frames[f].start = length;
+        length += frame(Frames[f].payload, Frames[f].length, &Wire[length]);
+        Frames[f].end = length - 1;
+        touched[f] = 0;
+    }
+
+    // damage every fourth frame on average, never its delimiter
+    for (f = 0; f < 64; f++) {
+        uint16_t at, span = Frames[f].end - Frames[f].start;
+
+        if (rnd() % 4 || span == 0)
+            continue;
+        at = Frames[f].start + (uint16_t)(rnd() % span);
+        switch (rnd() % 3) {
+            case 0:     // bit flip
+                Wire[at] ^= (uint8_t)(1 << (rnd() % 8));
+                break;
+            case 1:     // dropped byte, kept in place as a repeat of its neighbour
+                Wire[at] = Wire[at + 1] ? Wire[at + 1] : 0x01;
+                break;
+            default:    // inserted delimiter
+                Wire[at] = 0;
+                break;
+        }
+        touched[f] = 1;
+        (*damaged)++;
+    }
+
+    // receive: split on delimiters, match the results to the frames sent
+    for (i = 0; i < length; i++) {
+        int received;
+
+        if (Wire[i] != 0)
+            continue;
+        received = unframe(&Wire[start], i - start, payload);
+        while (expect < 64 && Frames[expect].end < i)
+            expect++;
+        if (Frames[expect].end == i && Frames[expect].start == start) {
+            // a whole frame, damaged or not
+            if (!touched[expect]) {
+                if (received != Frames[expect].length ||
+                    memcmp(payload, Frames[expect].payload, received)) {
+                    printf("damaged frames     FAIL: clean frame lost\n");
+                    return 1;
+                }
+            } else if (received < 0) {
+                (*rejected)++;
+            } else if (received != Frames[expect].length ||
+                       memcmp(payload, Frames[expect].payload, received)) {
+                (*false_accepts)++;
+            }   // else the damage left the frame as it was
+        } else if (received < 0) {
+            (*fragments)++;         // a piece of a frame split by a delimiter
+        } else {
+            (*false_accepts)++;
+        }
+        start = i + 1;
+    }
+    return 0;
+}
+
+static int check_damaged(void)
+{
+    unsigned long damaged = 0, rejected = 0, fragments = 0, false_accepts = 0;
+    uint32_t round;
+
+    for (round = 0; round < FRAMES / 64 * ROUNDS; round++) {
+        if (check_damaged_round(&damaged, &rejected, &fragments, &false_accepts))
+            return 1;
+    }
+    printf("damaged frames     %s %lu damaged: %lu rejected, %lu fragments rejected, "
+           "%lu false accepts\n", false_accepts * 1000 > damaged ? "FAIL" : "ok  ",
+           damaged, rejected, fragments, false_accepts);
+    return false_accepts * 1000 > damaged;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    failed |= check_crc();
+    failed |= check_clean();
+    failed |= check_damaged();
+    return failed;
+}
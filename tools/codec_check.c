@@ -0,0 +1,218 @@
+//******************************************************************************
+// Host round-trip check of the FRAM log sample codec (sample_codec.h)
+//
+// Encodes a corpus of sample streams into blocks the way fram_log.c fills
+// them, decodes every block again and compares the result with the input
+// sample by sample. The corpus covers a steady log, slow drifts, a noisy
+// current, mode changes, irregular and wrapping timestamps and random
+// full-range values. It also checks that every full-range sample fits an
+// empty block and that a block with a bad count byte never decodes past its
+// end. Prints bytes per sample for each stream and exits with 1 on a mismatch.
+//
+// Build:  gcc -O2 -I../AdaptiveSampling -o codec_check codec_check.c ../AdaptiveSampling/sample_codec.c
+// Usage:  ./codec_check
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sample_codec.h"
+
+#define CORPUS_SAMPLES  20000
+#define CORPUS_BLOCKS   (CORPUS_SAMPLES + 1)    // worst case one sample per block
+
+typedef enum StreamEnum{
+    STREAM_STEADY,
+    STREAM_DRIFT,
+    STREAM_NOISY,
+    STREAM_MODES,
+    STREAM_IRREGULAR,
+    STREAM_WRAP,
+    STREAM_RANDOM,
+    STREAMS
+} Stream;
+
+static const char *StreamName[STREAMS] = {
+    "steady", "drift", "noisy current", "mode changes", "irregular time",
+    "timestamp wrap", "random full-range"
+};
+
+static LogRecord Input[CORPUS_SAMPLES];
+static LogRecord Output[CORPUS_SAMPLES];
+static uint8_t Blocks[CORPUS_BLOCKS][CODEC_BLOCK_SIZE];
+static uint32_t Seed = 12345;
+
+static uint32_t rnd(void)
+{
+    Seed = Seed * 1103515245UL + 12345;
+    return (Seed >> 8) & 0xFFFFFF;
+}
+
+static uint32_t rnd32(void)
+{
+    return (rnd() << 16) ^ rnd();
+}
+
+static void make_stream(Stream stream, LogRecord *r, uint32_t count)
+{
+    uint32_t i;
+    uint32_t t = 0;
+
+    for (i = 0; i < count; i++) {
+        LogRecord *s = &r[i];
+
+        s->timestamp = t;
+        s->co2 = 420;
+        s->temperature = 2150;
+        s->vcell = 3900;
+        s->current = -1200;
+        s->soc = 80;
+        s->mode = 1;
+        t += 10;
+
+        switch (stream) {
+            case STREAM_STEADY:
+                break;
+            case STREAM_DRIFT:
+                s->co2 = (uint16_t)(420 + i / 7);
+                s->temperature = (int16_t)(2150 - (int32_t)(i / 13));
+                s->vcell = (uint16_t)(4200 - i / 40);
+                s->soc = (uint8_t)(100 - i / 250);
+                break;
+            case STREAM_NOISY:
+                s->current = (int16_t)(-1200 + (int32_t)(rnd() % 801) - 400);
+                s->co2 = (uint16_t)(420 + rnd() % 20);
+                break;
+            case STREAM_MODES:
+                s->mode = (uint8_t)((i / 50) % 4);
+                s->timestamp = (uint32_t)i * (s->mode == 3 ? 60 : 10);
+                break;
+            case STREAM_IRREGULAR:
+                t += rnd() % 3 == 0 ? rnd() % 100000 : 0;
+                break;
+            case STREAM_WRAP:
+                s->timestamp = 0xFFFFFFFFUL - 50000 + (uint32_t)i * 7;
+                break;
+            case STREAM_RANDOM:
+            default:
+                s->timestamp = rnd32();
+                s->co2 = (uint16_t)rnd();
+                s->temperature = (int16_t)rnd();
+                s->vcell = (uint16_t)rnd();
+                s->current = (int16_t)rnd();
+                s->soc = (uint8_t)rnd();
+                s->mode = (uint8_t)rnd();
+                break;
+        }
+    }
+}
+
+static int same(const LogRecord *a, const LogRecord *b)
+{
+    return a->timestamp == b->timestamp && a->co2 == b->co2 &&
+           a->temperature == b->temperature && a->vcell == b->vcell &&
+           a->current == b->current && a->soc == b->soc && a->mode == b->mode;
+}
+
+// encodes like fram_log.c: a full block is closed and the sample retried
+static uint32_t encode(const LogRecord *r, uint32_t count)
+{
+    CodecState enc;
+    uint32_t block = 0;
+    uint32_t i;
+
+    memset(Blocks, 0, sizeof(Blocks));
+    codec_block_begin(&enc);
+    for (i = 0; i < count; i++) {
+        if (!codec_encode(&enc, &r[i], Blocks[block])) {
+            block++;
+            codec_block_begin(&enc);
+            if (!codec_encode(&enc, &r[i], Blocks[block])) {
+                fprintf(stderr, "sample %lu does not fit an empty block\n",
+                        (unsigned long)i);
+                return 0;
+            }
+        }
+    }
+    return block + 1;
+}
+
+static uint32_t decode(uint32_t blocks, LogRecord *r)
+{
+    uint32_t n = 0;
+    uint32_t b;
+
+    for (b = 0; b < blocks; b++) {
+        CodecState dec;
+
+        codec_decode_begin(&dec);
+        while (n < CORPUS_SAMPLES && codec_decode(&dec, Blocks[b], &r[n]))
+            n++;
+    }
+    return n;
+}
+
+static int check_stream(Stream stream)
+{
+    uint32_t blocks, decoded, i;
+
+    make_stream(stream, Input, CORPUS_SAMPLES);
+    blocks = encode(Input, CORPUS_SAMPLES);
+    if (!blocks)
+        return 1;
+    decoded = decode(blocks, Output);
+    if (decoded != CORPUS_SAMPLES) {
+        printf("%-18s FAIL: %lu of %u samples decoded\n", StreamName[stream],
+               (unsigned long)decoded, CORPUS_SAMPLES);
+        return 1;
+    }
+    for (i = 0; i < CORPUS_SAMPLES; i++) {
+        if (!same(&Input[i], &Output[i])) {
+            printf("%-18s FAIL: sample %lu differs\n", StreamName[stream],
+                   (unsigned long)i);
+            return 1;
+        }
+    }
+    printf("%-18s ok  %5lu blocks, %5.2f bytes per sample\n", StreamName[stream],
+           (unsigned long)blocks,
+           (double)blocks * CODEC_BLOCK_SIZE / CORPUS_SAMPLES);
+    return 0;
+}
+
+// a corrupted count byte may only end the block early, never overrun it
+static int check_bad_count(void)
+{
+    uint32_t blocks, b;
+
+    make_stream(STREAM_RANDOM, Input, CORPUS_SAMPLES);
+    blocks = encode(Input, CORPUS_SAMPLES);
+    for (b = 0; b < blocks; b++) {
+        CodecState dec;
+        LogRecord r;
+        uint8_t n = 0;
+
+        Blocks[b][0] = 0xFF;
+        codec_decode_begin(&dec);
+        while (codec_decode(&dec, Blocks[b], &r))
+            n++;
+        if (dec.length > CODEC_BLOCK_SIZE + 1 || n > CODEC_BLOCK_SIZE) {
+            printf("bad count          FAIL: block %lu read to %u\n",
+                   (unsigned long)b, dec.length);
+            return 1;
+        }
+    }
+    printf("bad count          ok  %5lu blocks stay in bounds\n", (unsigned long)blocks);
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+    Stream s;
+
+    for (s = STREAM_STEADY; s < STREAMS; s++)
+        failed |= check_stream(s);
+    failed |= check_bad_count();
+    return failed;
+}
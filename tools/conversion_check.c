@@ -0,0 +1,74 @@
+//******************************************************************************
+// Host check of the fixed-point unit conversions (conversion.h)
+//
+// Runs every conversion over its whole 16-bit input range and compares it
+// with the floating-point formula of the data sheet. Prints the largest
+// error per conversion in output units; rounding to nearest allows 0.5.
+// Exits with 1 if any conversion is off by more than that. The host int is
+// 32 bit, so an addition that overflows the MSP430's 16-bit int goes unseen
+// here; the conversions widen such sums explicitly.
+//
+// Build:  gcc -O2 -I../AdaptiveSampling -o conversion_check conversion_check.c -lm
+// Usage:  ./conversion_check
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include "conversion.h"
+
+#define LIMIT   (0.5 + 1e-9)
+
+typedef struct CheckStruct{
+    const char *name;
+    const char *unit;
+    double max_error;
+    uint16_t worst_input;
+} Check;
+
+static void record(Check *check, uint16_t input, double fixed, double reference)
+{
+    double error = fabs(fixed - reference);
+
+    if (error > check->max_error) {
+        check->max_error = error;
+        check->worst_input = input;
+    }
+}
+
+int main(void)
+{
+    Check checks[] = {
+        {"convertGas",          "ppm",      0, 0},
+        {"convertTemperature",  "0.01 degC", 0, 0},
+        {"convertCAP",          "uAh",      0, 0},
+        {"convertSOC",          "%",        0, 0},
+        {"convertV",            "mV",       0, 0},
+        {"convertCurrent",      "uA",       0, 0},
+    };
+    const unsigned count = sizeof(checks) / sizeof(checks[0]);
+    unsigned i, failed = 0;
+    uint32_t input;
+
+    for (input = 0; input <= 0xFFFF; input++) {
+        uint16_t d = (uint16_t)input;
+        double gas = 1e6 * ((double)d - 16384) / 32768;
+
+        record(&checks[0], d, convertGas(d), gas < 0 ? 0 : gas);
+        record(&checks[1], d, convertTemperature(d), (int16_t)d / 200.0 * 100);
+        record(&checks[2], d, convertCAP(d), d * 50.0);
+        record(&checks[3], d, convertSOC(d), d / 256.0);
+        record(&checks[4], d, convertV(d), d * 0.078125);
+        record(&checks[5], d, convertCurrent(d), (int16_t)d * 15.625);
+    }
+
+    for (i = 0; i < count; i++) {
+        const char *verdict = checks[i].max_error > LIMIT ? "FAIL" : "ok";
+
+        printf("%-20s max error %.4f %-10s at 0x%04X  %s\n", checks[i].name,
+               checks[i].max_error, checks[i].unit, checks[i].worst_input, verdict);
+        if (checks[i].max_error > LIMIT)
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+//******************************************************************************
+// Host decoder for the AdaptiveSampling FRAM log
+//
+// Reads a raw memory dump of the Log object (debugger "Save Memory" or the
+// UART export) and prints the samples as CSV, oldest first.
+//
+// Build:  gcc -O2 -I../AdaptiveSampling -o log_decode log_decode.c ../AdaptiveSampling/sample_codec.c
+// Usage:  ./log_decode log.bin > log.csv
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "fram_log.h"
+
+// the dump is little endian like the MSP430, read the header byte by byte
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t raw[sizeof(FramLog)];
+    const uint8_t *blocks = raw + sizeof(LogHeader);
+    uint16_t total, closed, i;
+    unsigned long samples = 0;
+    FILE *f;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <log dump>\n", argv[0]);
+        return 1;
+    }
+    f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(raw, 1, sizeof(raw), f) != sizeof(raw)) {
+        fprintf(stderr, "%s: expected %u bytes\n", argv[1], (unsigned)sizeof(raw));
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    total = get16(raw);
+    closed = total > FRAM_LOG_BLOCKS - 1 ? FRAM_LOG_BLOCKS - 1 : total;
+    fprintf(stderr, "total %u, decimation %u, clock %lu s\n", total,
+            get16(raw + 2), (unsigned long)get32(raw + 4));
+
+    printf("timestamp_s,co2_ppm,temperature_cdegC,vcell_mV,current_uA,soc_pct,mode\n");
+    for (i = 0; i <= closed; i++) {
+        const uint8_t *block = blocks +
+            ((total - closed + i) & (FRAM_LOG_BLOCKS - 1)) * CODEC_BLOCK_SIZE;
+        CodecState dec;
+        LogRecord r;
+
+        codec_decode_begin(&dec);
+        while (codec_decode(&dec, block, &r)) {
+            printf("%lu,%u,%d,%u,%d,%u,%u\n", (unsigned long)r.timestamp, r.co2,
+                   r.temperature, r.vcell, r.current, r.soc, r.mode);
+            samples++;
+        }
+    }
+    fprintf(stderr, "%lu samples in %u blocks\n", samples, closed + 1);
+    return 0;
+}
@@ -0,0 +1,238 @@
+//******************************************************************************
+// Host receiver for the AdaptiveSampling UART log export
+//
+// Downloads the FRAM log over the export protocol (see uart_export.h) and
+// writes a dump in the layout of the Log object, which tools/log_decode turns
+// into CSV. Closed blocks are saved to <output>.part as they arrive; if the
+// transfer is interrupted, running the same command again resumes from the
+// first missing block, corrected for the blocks the device closed meanwhile.
+//
+// Build:  gcc -O2 -I../AdaptiveSampling -o log_receive log_receive.c ../AdaptiveSampling/cobs.c
+// Usage:  ./log_receive /dev/ttyUSB0 log.bin
+//******************************************************************************
+
+#define _DEFAULT_SOURCE     // cfmakeraw() also with -std=c99
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include "cobs.h"
+#include "fram_log.h"
+#include "uart_export.h"
+
+#define FRAME_MAX       256
+#define TIMEOUT_MS      500
+#define RETRIES         5
+
+static int port;
+static uint8_t blocks[FRAM_LOG_BLOCKS][CODEC_BLOCK_SIZE];
+static uint16_t received;       // closed blocks in blocks[], oldest first
+static uint16_t part_total;     // device total the part file refers to
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void put16(uint8_t *p, uint16_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static int open_port(const char *path)
+{
+    struct termios tio;
+    int fd = open(path, O_RDWR | O_NOCTTY);
+
+    if (fd < 0 || tcgetattr(fd, &tio) < 0)
+        return -1;
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B1000000);
+    cfsetospeed(&tio, B1000000);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) < 0)
+        return -1;
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+static int send_request(const uint8_t *payload, uint16_t length)
+{
+    uint8_t buf[FRAME_MAX], frame[FRAME_MAX];
+    uint16_t n;
+
+    memcpy(buf, payload, length);
+    put16(&buf[length], crc16_ccitt(buf, length));
+    frame[0] = 0;       // wakes the UART and flushes a partial frame
+    n = cobs_encode(buf, length + 2, &frame[1]) + 1;
+    frame[n++] = 0;
+    return write(port, frame, n) == n ? 0 : -1;
+}
+
+// returns the payload length of the next valid frame, 0 on timeout
+static uint16_t read_frame(uint8_t *payload)
+{
+    uint8_t frame[FRAME_MAX], byte;
+    uint16_t length = 0, n;
+    struct timeval tv;
+    fd_set fds;
+
+    for (;;) {
+        FD_ZERO(&fds);
+        FD_SET(port, &fds);
+        tv.tv_sec = 0;
+        tv.tv_usec = TIMEOUT_MS * 1000;
+        if (select(port + 1, &fds, NULL, NULL, &tv) <= 0)
+            return 0;
+        if (read(port, &byte, 1) != 1)
+            return 0;
+        if (byte != 0) {
+            if (length < FRAME_MAX)
+                frame[length++] = byte;
+            continue;
+        }
+        n = length ? cobs_decode(frame, length, payload) : 0;
+        length = 0;
+        if (n >= 3 && crc16_ccitt(payload, n - 2) == get16(&payload[n - 2]))
+            return n - 2;
+    }
+}
+
+// first block that still exists on the device, in units of closed blocks
+static uint16_t oldest(uint16_t total)
+{
+    return total < FRAM_LOG_BLOCKS ? 0 : total - (FRAM_LOG_BLOCKS - 1);
+}
+
+static void load_part(const char *path)
+{
+    uint8_t hdr[4];
+    FILE *f = fopen(path, "rb");
+
+    received = 0;
+    if (!f)
+        return;
+    if (fread(hdr, 1, 4, f) == 4) {
+        part_total = get16(hdr);
+        received = get16(hdr + 2);
+        if (received >= FRAM_LOG_BLOCKS ||
+            fread(blocks, CODEC_BLOCK_SIZE, received, f) != received)
+            received = 0;
+    }
+    fclose(f);
+}
+
+static void save_part(const char *path)
+{
+    uint8_t hdr[4];
+    FILE *f = fopen(path, "wb");
+
+    if (!f)
+        return;
+    put16(hdr, part_total);
+    put16(hdr + 2, received);
+    fwrite(hdr, 1, 4, f);
+    fwrite(blocks, CODEC_BLOCK_SIZE, received, f);
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t payload[FRAME_MAX], request[5], header[sizeof(LogHeader)];
+    uint8_t open_block[CODEC_BLOCK_SIZE];
+    uint16_t total = 0, count = 0, next, shift, length;
+    char part[1024];
+    int tries, done = 0;
+    FILE *f;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <serial port> <output>\n", argv[0]);
+        return 1;
+    }
+    port = open_port(argv[1]);
+    if (port < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    snprintf(part, sizeof(part), "%s.part", argv[2]);
+    load_part(part);
+
+    for (tries = 0; tries < RETRIES && !done; tries++) {
+        // where is the ring now, and which of our blocks are still valid
+        request[0] = EXPORT_CMD_INFO;
+        send_request(request, 1);
+        length = read_frame(payload);
+        if (length < 12 || payload[0] != EXPORT_RSP_INFO ||
+            payload[5] != CODEC_BLOCK_SIZE)
+            continue;
+        total = get16(&payload[1]);
+        count = get16(&payload[3]);
+        memcpy(header, &payload[1], 2);
+        memcpy(header + 2, &payload[6], 6);
+
+        if (received) {
+            shift = (oldest(total) - oldest(part_total)) % FRAM_LOG_BLOCKS;
+            if (total != part_total && shift >= received) {
+                received = 0;
+            } else if (shift) {
+                memmove(blocks[0], blocks[shift], (received - shift) * CODEC_BLOCK_SIZE);
+                received -= shift;
+            }
+        }
+        part_total = total;
+        fprintf(stderr, "device: %u blocks, resuming at %u\n", count, received);
+        if (length >= 16)
+            fprintf(stderr, "device: boot %u ms, wake-up %u ms\n",
+                    get16(&payload[12]), get16(&payload[14]));
+
+        request[0] = EXPORT_CMD_READ;
+        put16(&request[1], received);
+        put16(&request[3], count - received);
+        send_request(request, 5);
+
+        while ((length = read_frame(payload)) != 0) {
+            if (payload[0] == EXPORT_RSP_END) {
+                done = 1;
+                break;
+            }
+            if (payload[0] != EXPORT_RSP_BLOCK || length != 5 + CODEC_BLOCK_SIZE)
+                continue;
+            next = get16(&payload[1]);
+            if (get16(&payload[3]) != total || next != received)
+                break;  // ring moved or a frame was lost, start over
+            if (next == count - 1) {
+                memcpy(open_block, &payload[5], CODEC_BLOCK_SIZE);
+                continue;
+            }
+            memcpy(blocks[received++], &payload[5], CODEC_BLOCK_SIZE);
+            save_part(part);
+        }
+    }
+    if (!done) {
+        fprintf(stderr, "transfer interrupted after %u blocks, run again to resume\n",
+                received);
+        return 1;
+    }
+
+    // closed blocks in slots 0..n-2, open block last, total = closed blocks
+    f = fopen(argv[2], "wb");
+    if (!f) {
+        perror(argv[2]);
+        return 1;
+    }
+    put16(header, received);
+    fwrite(header, 1, sizeof(header), f);
+    memcpy(blocks[received], open_block, CODEC_BLOCK_SIZE);
+    fwrite(blocks, CODEC_BLOCK_SIZE, FRAM_LOG_BLOCKS, f);
+    fclose(f);
+    unlink(part);
+    fprintf(stderr, "%u blocks written to %s\n", received + 1, argv[2]);
+    return 0;
+}
@@ -0,0 +1,118 @@
+//******************************************************************************
+// Host two-thread stress check of the SPSC ring (ring.h)
+//
+// One thread produces a running sequence number, another consumes it, both
+// as fast as they can, through rings of 1, 2, 16 and 256 slots. The consumer
+// checks that every entry arrives exactly once and in order and that
+// ring_count() never exceeds the slots. A full or empty ring yields the CPU,
+// so the check also runs on a single core. Built on the host, ring.h uses its
+// C11 atomics; build it with -fsanitize=thread as well to have the accesses
+// checked for races. Exits with 1 on a failure.
+//
+// Build:  gcc -O2 -std=c11 -pthread -I../AdaptiveSampling -o ring_check ring_check.c
+// Usage:  ./ring_check [entries per ring]
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+
+#define ENTRIES     2000000UL
+
+RING_STORAGE(Slots1, 1);
+RING_STORAGE(Slots2, 2);
+RING_STORAGE(Slots16, 16);
+RING_STORAGE(Slots256, 256);
+
+typedef struct CaseStruct{
+    const char *name;
+    Ring ring;
+    unsigned long full;         // times the producer found the ring full
+    unsigned long empty;        // times the consumer found it empty
+} Case;
+
+static Case Cases[] = {
+    {"1 slot",     RING_INIT(Slots1),   0, 0},
+    {"2 slots",    RING_INIT(Slots2),   0, 0},
+    {"16 slots",   RING_INIT(Slots16),  0, 0},
+    {"256 slots",  RING_INIT(Slots256), 0, 0},
+};
+
+static unsigned long Entries = ENTRIES;
+
+static void *produce(void *arg)
+{
+    Case *c = arg;
+    unsigned long i;
+
+    for (i = 0; i < Entries; i++) {
+        while (!ring_put(&c->ring, (uint16_t)i)) {
+            c->full++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// runs in the calling thread, returns 0 when everything arrived in order
+static int consume(Case *c)
+{
+    unsigned long i;
+    uint16_t value;
+
+    for (i = 0; i < Entries; i++) {
+        while (!ring_get(&c->ring, &value)) {
+            c->empty++;
+            sched_yield();
+        }
+        if (value != (uint16_t)i) {
+            printf("%-10s FAIL: entry %lu is %u, expected %u\n", c->name, i,
+                   value, (uint16_t)i);
+            return 1;
+        }
+        if (ring_count(&c->ring) > (uint16_t)(c->ring.mask + 1)) {
+            printf("%-10s FAIL: %u entries counted in %u slots\n", c->name,
+                   ring_count(&c->ring), c->ring.mask + 1);
+            return 1;
+        }
+    }
+    if (ring_get(&c->ring, &value)) {
+        printf("%-10s FAIL: entry %u left over\n", c->name, value);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const unsigned count = sizeof(Cases) / sizeof(Cases[0]);
+    unsigned i;
+    int failed = 0;
+
+    if (argc > 1)
+        Entries = strtoul(argv[1], NULL, 0);
+
+    for (i = 0; i < count; i++) {
+        Case *c = &Cases[i];
+        pthread_t producer;
+        int result;
+
+        if (pthread_create(&producer, NULL, produce, c)) {
+            fprintf(stderr, "cannot start the producer\n");
+            return 1;
+        }
+        result = consume(c);
+        if (result) {
+            // the producer would wait forever for room, the check is over
+            failed = 1;
+            break;
+        }
+        pthread_join(producer, NULL);
+        printf("%-10s ok   %lu entries, full %lu times, empty %lu times\n",
+               c->name, Entries, c->full, c->empty);
+    }
+    return failed;
+}
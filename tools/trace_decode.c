@@ -0,0 +1,206 @@
+//******************************************************************************
+// Host decoder for the event trace (TRACE=1)
+//
+// Reads a raw memory dump of the Trace object and writes Chrome trace JSON,
+// which chrome://tracing and ui.perfetto.dev show as a timeline with one
+// track each for the CPU power state, the I2C bus, SPI and the display.
+// Times are in microseconds from the oldest event in the ring.
+//
+// Build:  gcc -O2 -I../AdaptiveSampling -o trace_decode trace_decode.c
+// Usage:  ./trace_decode trace.bin > trace.json
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include "trace.h"
+#include "event.h"
+
+#define TRACK_CPU       1
+#define TRACK_I2C       2
+#define TRACK_SPI       3
+#define TRACK_DISPLAY   4
+
+static int first = 1;
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static const char *device_name(uint8_t address)
+{
+    switch (address) {
+        case 0x29:
+        case 0x2A:
+        case 0x2B:
+        case 0x2C: return "STC31";
+        case 0x36: return "MAX17260";
+        default:   return "I2C";
+    }
+}
+
+static const char *command_name(uint8_t low)
+{
+    switch (low) {
+        case 0x15: return "set_binary_gas";
+        case 0x24: return "set_relative_humidity";
+        case 0x1E: return "set_temperature";
+        case 0x2F: return "set_pressure";
+        case 0x39: return "measure_gas_concentration";
+        case 0x61: return "forced_recalibration";
+        case 0xEF: return "enable_self_calibration";
+        case 0x6E: return "disable_self_calibration";
+        case 0x52: return "prepare_read_state";
+        case 0x33: return "sensor_state";
+        case 0x50: return "apply_state";
+        case 0x5B: return "self_test";
+        case 0x77: return "enter_sleep_mode";
+        case 0x7C: return "prepare_product_identifier";
+        case 0x02: return "read_product_identifier";
+        default:   return "command";
+    }
+}
+
+static const char *event_name(uint8_t event)
+{
+    switch (event) {
+        case EVENT_I2C_DONE:  return "wake i2c";
+        case EVENT_SPI_DONE:  return "wake spi";
+        case EVENT_CLOCK:     return "wake clock";
+        default:              return "wake";
+    }
+}
+
+static const char *lpm_name(uint8_t state)
+{
+    return state == 1 ? "LPM0" : state == 2 ? "LPM3" : "LPM";
+}
+
+static void emit(const char *name, char phase, double us, int track, const char *args)
+{
+    printf("%s\n  {\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.1f, \"pid\": 1, \"tid\": %d%s%s}",
+           first ? "" : ",", name, phase, us, track, args ? ", " : "", args ? args : "");
+    first = 0;
+}
+
+static void track_name(int track, const char *name)
+{
+    char args[64];
+
+    snprintf(args, sizeof(args), "\"args\": {\"name\": \"%s\"}", name);
+    emit("thread_name", 'M', 0, track, args);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t raw[sizeof(TraceBuffer)];
+    uint16_t head, full, count, start, i;
+    uint16_t last = 0;
+    uint32_t high = 0, base = 0;
+    int pending = 0;
+    char args[64], name[48];
+    FILE *f;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace dump>\n", argv[0]);
+        return 1;
+    }
+    f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (fread(raw, 1, sizeof(raw), f) != sizeof(raw)) {
+        fprintf(stderr, "%s: expected %u bytes\n", argv[1], (unsigned)sizeof(raw));
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    head = get16(raw) & (TRACE_EVENTS - 1);
+    full = get16(raw + 2);
+    count = full ? TRACE_EVENTS : head;
+    start = full ? head : 0;
+
+    printf("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    track_name(TRACK_CPU, "CPU");
+    track_name(TRACK_I2C, "I2C");
+    track_name(TRACK_SPI, "SPI");
+    track_name(TRACK_DISPLAY, "Display");
+
+    for (i = 0; i < count; i++) {
+        const uint8_t *e = raw + 4 + ((start + i) & (TRACE_EVENTS - 1)) * sizeof(TraceEvent);
+        uint16_t time = get16(e);
+        uint8_t id = e[2], arg = e[3];
+        double us;
+
+        // The overflow ISR logs TRACE_WRAP, but an event may read TA3R after
+        // the overflow and before the ISR runs. A step back in time counts as
+        // the wrap and the TRACE_WRAP that follows is skipped.
+        if (i && time < last) {
+            high++;
+            pending = 1;
+        }
+        if (id == TRACE_WRAP) {
+            if (pending)
+                pending = 0;
+            else if (i)
+                high++;
+        }
+        last = time;
+        if (i == 0)
+            base = time;
+        us = (double)(((high << 16) | time) - base) * 1e6 / TIMEBASE_HZ;
+
+        switch (id) {
+            case TRACE_CYCLE:
+                snprintf(name, sizeof(name), "cycle mode %u", arg);
+                emit(name, 'i', us, TRACK_CPU, "\"s\": \"g\"");
+                break;
+            case TRACE_LPM_ENTER:
+                emit(lpm_name(arg), 'B', us, TRACK_CPU, NULL);
+                break;
+            case TRACE_LPM_EXIT:
+                emit(lpm_name(arg), 'E', us, TRACK_CPU, NULL);
+                break;
+            case TRACE_I2C_START:
+                snprintf(args, sizeof(args), "\"args\": {\"address\": \"0x%02X\"}", arg);
+                emit(device_name(arg), 'B', us, TRACK_I2C, args);
+                break;
+            case TRACE_I2C_STOP:
+                emit(device_name(arg), 'E', us, TRACK_I2C, NULL);
+                break;
+            case TRACE_REG_READ:
+            case TRACE_REG_WRITE:
+                snprintf(name, sizeof(name), "%s 0x%02X",
+                         id == TRACE_REG_READ ? "read" : "write", arg);
+                emit(name, 'i', us, TRACK_I2C, "\"s\": \"t\"");
+                break;
+            case TRACE_STC_CMD:
+                emit(command_name(arg), 'i', us, TRACK_I2C, "\"s\": \"t\"");
+                break;
+            case TRACE_SPI_START:
+                snprintf(args, sizeof(args), "\"args\": {\"bytes\": %u}", arg);
+                emit("frame", 'B', us, TRACK_SPI, args);
+                break;
+            case TRACE_SPI_END:
+                emit("frame", 'E', us, TRACK_SPI, NULL);
+                break;
+            case TRACE_DISPLAY_START:
+                emit("display frame", 'B', us, TRACK_DISPLAY, NULL);
+                break;
+            case TRACE_DISPLAY_END:
+                emit("display frame", 'E', us, TRACK_DISPLAY, NULL);
+                break;
+            case TRACE_TASK_WAKE:
+                emit(event_name(arg), 'i', us, TRACK_CPU, "\"s\": \"t\"");
+                break;
+            default:
+                break;
+        }
+    }
+    printf("\n]}\n");
+    fprintf(stderr, "%u events, %.3f s\n", count,
+            (double)(((high << 16) | last) - base) / TIMEBASE_HZ);
+    return 0;
+}